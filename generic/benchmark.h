@@ -0,0 +1,822 @@
+#pragma once
+
+// Small micro-benchmark framework, built on top of measure_cycles2_raw.
+//
+// BENCH(name, params...) registers a benchmark, params being any number of parameter
+// sweeps (run as a cartesian product), which the body reads via state.param(i).
+// The body does any setup it needs, then calls state.measure with the thing to time,
+// iterations per sample are calibrated so the whole benchmark fits the time budget.
+//
+//  BENCH(sortInts, bench::range(16, 4096, 4), bench::values({0, 1}))
+//  {
+//      std::vector<int> source = makeData(state.param(0), state.param(1) != 0);
+//      std::vector<int> data;
+//      state.setItemsProcessed(state.param(0));
+//      state.measure([&]{
+//          data = source;
+//          std::sort(data.begin(), data.end());
+//          bench::doNotOptimize(data.data());
+//      });
+//  }
+//
+//  BENCH_MAIN();
+//
+// Command line:
+//
+//  --filter=<substring>                Only run benchmarks whose name contains this
+//  --format=console|json|csv           Output format (default: console)
+//  --out=<path>                        Write to a file rather than stdout
+//  --budget-ms=<ms>                    Time budget per benchmark (default: 500)
+//  --samples=<count>                   Samples per benchmark (default: 31)
+//  --compare <base.json> <new.json>    Compare two json results, see below
+//  --alpha=<p>                         Significance level for --compare (default: 0.01)
+//  --threshold=<ratio>                 Min relative change for --compare (default: 0.05)
+//  --counters                          Also collect perf counters (see perf_counters.h)
+//
+// Compare mode runs a Mann-Whitney U test over the per sample timings of each benchmark
+// found in both files, flagging a regression (and exiting with 1) when it is both
+// statistically significant and slower by more than the threshold.
+//
+// Timings are reported per iteration as the median / MAD over all samples, both as
+// TSC cycles (via measure_cycles2_raw) and nanoseconds (via steady_clock).
+// With --counters, core cycles / instructions / cache misses etc are also reported per
+// iteration, along with IPC, when perf_event_open is usable (otherwise they're skipped).
+//
+
+#include "measure_cycles_2.h"
+#include "perf_counters.h"
+
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace bench
+{
+
+// Stops the compiler optimizing away a value, or the calculations leading to it
+#if defined(_MSC_VER)
+
+NOINLINE inline void useCharPointer(char const volatile*) {}
+
+template<typename T>
+inline void doNotOptimize(T const& value)
+{
+    useCharPointer(&reinterpret_cast<char const volatile&>(value));
+    _ReadWriteBarrier();
+}
+
+// Forces any pending writes to memory to happen
+inline void clobberMemory()
+{
+    _ReadWriteBarrier();
+}
+
+#else
+
+template<typename T>
+inline __attribute__((always_inline)) void doNotOptimize(T const& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template<typename T>
+inline __attribute__((always_inline)) void doNotOptimize(T& value)
+{
+    asm volatile("" : "+r,m"(value) : : "memory");
+}
+
+inline __attribute__((always_inline)) void clobberMemory()
+{
+    asm volatile("" : : : "memory");
+}
+
+#endif
+
+
+// Parameter sweeps
+
+using ParamValues = std::vector<int64_t>;
+
+// [low, high], multiplying by multiplier each step (high is always included)
+inline ParamValues range(int64_t low, int64_t high, int64_t multiplier=2)
+{
+    ParamValues result;
+    for(int64_t value=low; value < high; value = (value * multiplier > value) ? value * multiplier : value + 1)
+    {
+        result.push_back(value);
+    }
+    result.push_back(high);
+    return result;
+}
+
+// [low, high], adding step each time (high is always included)
+inline ParamValues dense(int64_t low, int64_t high, int64_t step=1)
+{
+    ParamValues result;
+    for(int64_t value=low; value < high; value += step)
+    {
+        result.push_back(value);
+    }
+    result.push_back(high);
+    return result;
+}
+
+inline ParamValues values(std::initializer_list<int64_t> list)
+{
+    return ParamValues(list);
+}
+
+
+struct Result
+{
+    std::string             name;
+    std::vector<int64_t>    params;
+    uint64_t                iterations = 0;         // Per sample
+    double                  medianCycles = 0.0;     // Per iteration
+    double                  madCycles = 0.0;
+    double                  medianNs = 0.0;
+    double                  madNs = 0.0;
+    double                  itemsPerSecond = 0.0;   // 0 when not set
+    double                  bytesPerSecond = 0.0;
+    std::vector<double>     samplesNs;              // Per iteration, for compare
+    bool                    hasCounters = false;    // Options::counters and perf_event_open worked
+    PerfCounterStats        counters[PERF_COUNTER_COUNT];   // Per iteration
+    double                  ipc = 0.0;
+};
+
+
+struct Options
+{
+    double      budgetMs = 500.0;
+    uint32_t    samples = 31;
+    bool        counters = false;
+};
+
+
+namespace detail
+{
+
+inline double median(std::vector<double> values)
+{
+    if(values.empty()) { return 0.0; }
+    std::sort(values.begin(), values.end());
+    const size_t n = values.size();
+    return (n & 1) ? values[n/2] : 0.5 * (values[n/2 - 1] + values[n/2]);
+}
+
+inline std::pair<double, double> medianMad(const std::vector<double>& values)
+{
+    const double m = median(values);
+    std::vector<double> deviations(values.size());
+    for(size_t i=0; i<values.size(); ++i)
+    {
+        deviations[i] = std::abs(values[i] - m);
+    }
+    return std::make_pair(m, median(std::move(deviations)));
+}
+
+} // namespace detail
+
+
+class State
+{
+public:
+    State(const std::vector<int64_t>& params, const Options& options)
+        : m_params(params)
+        , m_options(options)
+    {}
+
+    int64_t param(size_t index) const { return m_params.at(index); }
+    const std::vector<int64_t>& params() const { return m_params; }
+
+    // Per call of the measured callback
+    void setItemsProcessed(int64_t items) { m_items = items; }
+    void setBytesProcessed(int64_t bytes) { m_bytes = bytes; }
+
+    template<typename Callback>
+    void measure(Callback callback)
+    {
+        using clock = std::chrono::steady_clock;
+
+        uint64_t iterations = 1;
+        const auto runBatch = [&](uint64_t count, int64_t& cycles) -> double
+        {
+            const auto start = clock::now();
+            cycles = measure_cycles2_raw([&]{
+                for(uint64_t i=0; i<count; ++i) { callback(); }
+            });
+            return std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        };
+
+        // Calibrate, so each sample takes roughly budget / samples
+        const double targetNs = std::max(m_options.budgetMs * 1e6 / double(m_options.samples), 1000.0);
+        int64_t cycles = 0;
+        for(;;)
+        {
+            const double elapsed = runBatch(iterations, cycles);
+            if(elapsed >= targetNs || iterations >= (uint64_t(1) << 40))
+            {
+                break;
+            }
+            const double scale = elapsed > 0.0 ? (targetNs * 1.2) / elapsed : 10.0;
+            iterations = uint64_t(double(iterations) * std::min(std::max(scale, 2.0), 10.0));
+        }
+
+        // Warmup, then sample (stopping early if we're badly over budget)
+        runBatch(iterations, cycles);
+
+        std::vector<double> samplesNs;
+        std::vector<double> samplesCycles;
+        samplesNs.reserve(m_options.samples);
+        samplesCycles.reserve(m_options.samples);
+
+        // Counters are around the whole batch, the clock / rdtsc overhead is noise next to it
+        std::unique_ptr<PerfCounters> counters;
+        if(m_options.counters)
+        {
+            counters = std::make_unique<PerfCounters>();
+            if(!counters->available()) { counters.reset(); }
+        }
+        std::vector<double> samplesCounters[PERF_COUNTER_COUNT];
+        std::vector<double> samplesIpc;
+
+        const auto budgetEnd = clock::now() + std::chrono::duration<double, std::milli>(m_options.budgetMs * 2.0);
+        for(uint32_t i=0; i<m_options.samples; ++i)
+        {
+            if(counters) { counters->start(); }
+            const double elapsed = runBatch(iterations, cycles);
+            if(counters)
+            {
+                double values[PERF_COUNTER_COUNT];
+                if(counters->stop(values))
+                {
+                    for(size_t c=0; c<PERF_COUNTER_COUNT; ++c)
+                    {
+                        samplesCounters[c].push_back(values[c] / double(iterations));
+                    }
+                    const double coreCycles = values[size_t(PerfCounter::Cycles)];
+                    if(counters->has(PerfCounter::Instructions) && coreCycles > 0.0)
+                    {
+                        samplesIpc.push_back(values[size_t(PerfCounter::Instructions)] / coreCycles);
+                    }
+                }
+            }
+            samplesNs.push_back(elapsed / double(iterations));
+            samplesCycles.push_back(double(cycles) / double(iterations));
+            if(i >= 4 && clock::now() > budgetEnd)
+            {
+                break;
+            }
+        }
+
+        const auto ns = detail::medianMad(samplesNs);
+        const auto cyc = detail::medianMad(samplesCycles);
+        m_result.iterations = iterations;
+        m_result.medianNs = ns.first;
+        m_result.madNs = ns.second;
+        m_result.medianCycles = cyc.first;
+        m_result.madCycles = cyc.second;
+        m_result.itemsPerSecond = (m_items > 0 && ns.first > 0.0) ? double(m_items) * 1e9 / ns.first : 0.0;
+        m_result.bytesPerSecond = (m_bytes > 0 && ns.first > 0.0) ? double(m_bytes) * 1e9 / ns.first : 0.0;
+        m_result.samplesNs = std::move(samplesNs);
+        if(counters && !samplesCounters[0].empty())
+        {
+            m_result.hasCounters = true;
+            for(size_t c=0; c<PERF_COUNTER_COUNT; ++c)
+            {
+                const auto stats = detail::medianMad(samplesCounters[c]);
+                m_result.counters[c].median = stats.first;
+                m_result.counters[c].mad = stats.second;
+                m_result.counters[c].available = counters->has(PerfCounter(c));
+            }
+            m_result.ipc = detail::median(samplesIpc);
+        }
+        m_measured = true;
+    }
+
+    bool measured() const { return m_measured; }
+    Result& result() { return m_result; }
+
+private:
+    std::vector<int64_t>    m_params;
+    Options                 m_options;
+    int64_t                 m_items = 0;
+    int64_t                 m_bytes = 0;
+    bool                    m_measured = false;
+    Result                  m_result;
+};
+
+
+using BenchmarkFunction = void(*)(State&);
+
+struct Benchmark
+{
+    std::string                 name;
+    BenchmarkFunction           function;
+    std::vector<ParamValues>    params;
+};
+
+
+namespace detail
+{
+
+inline std::vector<Benchmark>& registry()
+{
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+template<typename... Params>
+inline bool registerBenchmark(const char* name, BenchmarkFunction function, Params... params)
+{
+    registry().push_back(Benchmark{name, function, std::vector<ParamValues>{ParamValues(params)...}});
+    return true;
+}
+
+inline std::string fullName(const std::string& name, const std::vector<int64_t>& params)
+{
+    std::string result = name;
+    for(int64_t param : params)
+    {
+        result += "/" + std::to_string(param);
+    }
+    return result;
+}
+
+// Cartesian product of all the parameter sweeps
+inline std::vector<std::vector<int64_t>> expandParams(const std::vector<ParamValues>& params)
+{
+    std::vector<std::vector<int64_t>> result(1);
+    for(const ParamValues& sweep : params)
+    {
+        std::vector<std::vector<int64_t>> next;
+        for(const auto& prefix : result)
+        {
+            for(int64_t value : sweep)
+            {
+                next.push_back(prefix);
+                next.back().push_back(value);
+            }
+        }
+        result = std::move(next);
+    }
+    return result;
+}
+
+inline std::string escapeJson(const std::string& value)
+{
+    std::string result;
+    for(char c : value)
+    {
+        switch(c)
+        {
+            case '"':  result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\n': result += "\\n"; break;
+            case '\t': result += "\\t"; break;
+            default:
+                if(uint8_t(c) < 0x20)
+                {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    result += buffer;
+                }
+                else
+                {
+                    result += c;
+                }
+        }
+    }
+    return result;
+}
+
+inline std::string formatDouble(double value)
+{
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.6g", value);
+    return buffer;
+}
+
+} // namespace detail
+
+
+inline std::vector<Result> runBenchmarks(const std::string& filter, const Options& options, std::ostream* progress=nullptr)
+{
+    std::vector<Result> results;
+    for(const Benchmark& benchmark : detail::registry())
+    {
+        for(const std::vector<int64_t>& params : detail::expandParams(benchmark.params))
+        {
+            const std::string name = detail::fullName(benchmark.name, params);
+            if(!filter.empty() && name.find(filter) == std::string::npos)
+            {
+                continue;
+            }
+            State state(params, options);
+            benchmark.function(state);
+            if(!state.measured())
+            {
+                if(progress) { *progress << name << ": state.measure was never called, skipping\n"; }
+                continue;
+            }
+            Result& result = state.result();
+            result.name = name;
+            result.params = params;
+            if(progress)
+            {
+                char buffer[256];
+                std::snprintf(
+                    buffer,
+                    sizeof(buffer),
+                    "%-40s %12.2f ns  +/- %-8.2f %12.1f cycles  +/- %-8.1f %10llu iters",
+                    name.c_str(),
+                    result.medianNs,
+                    result.madNs,
+                    result.medianCycles,
+                    result.madCycles,
+                    (unsigned long long)result.iterations
+                );
+                *progress << buffer;
+                if(result.bytesPerSecond > 0.0) { *progress << "  " << detail::formatDouble(result.bytesPerSecond / 1e9) << " GB/s"; }
+                if(result.itemsPerSecond > 0.0) { *progress << "  " << detail::formatDouble(result.itemsPerSecond / 1e6) << " M items/s"; }
+                if(result.ipc > 0.0) { *progress << "  ipc " << detail::formatDouble(result.ipc); }
+                *progress << std::endl;
+                for(size_t c=0; c<PERF_COUNTER_COUNT && result.hasCounters; ++c)
+                {
+                    if(!result.counters[c].available) { continue; }
+                    std::snprintf(
+                        buffer,
+                        sizeof(buffer),
+                        "    %-20s %14.2f  +/- %.2f\n",
+                        perfCounterName(PerfCounter(c)),
+                        result.counters[c].median,
+                        result.counters[c].mad
+                    );
+                    *progress << buffer;
+                }
+            }
+            results.push_back(std::move(result));
+        }
+    }
+    return results;
+}
+
+
+inline void writeJson(std::ostream& out, const std::vector<Result>& results)
+{
+    out << "{\n  \"benchmarks\": [\n";
+    for(size_t i=0; i<results.size(); ++i)
+    {
+        const Result& r = results[i];
+        out << "    {\"name\": \"" << detail::escapeJson(r.name) << "\", \"params\": [";
+        for(size_t j=0; j<r.params.size(); ++j)
+        {
+            out << (j ? ", " : "") << r.params[j];
+        }
+        out << "], \"iterations\": " << r.iterations
+            << ", \"median_ns\": " << detail::formatDouble(r.medianNs)
+            << ", \"mad_ns\": " << detail::formatDouble(r.madNs)
+            << ", \"median_cycles\": " << detail::formatDouble(r.medianCycles)
+            << ", \"mad_cycles\": " << detail::formatDouble(r.madCycles)
+            << ", \"items_per_second\": " << detail::formatDouble(r.itemsPerSecond)
+            << ", \"bytes_per_second\": " << detail::formatDouble(r.bytesPerSecond)
+            << ", \"samples_ns\": [";
+        for(size_t j=0; j<r.samplesNs.size(); ++j)
+        {
+            out << (j ? ", " : "") << detail::formatDouble(r.samplesNs[j]);
+        }
+        out << "]";
+        // Kept flat, readJsonSamples relies on the first '}' ending the object
+        for(size_t c=0; c<PERF_COUNTER_COUNT && r.hasCounters; ++c)
+        {
+            if(!r.counters[c].available) { continue; }
+            const char* name = perfCounterName(PerfCounter(c));
+            out << ", \"" << name << "\": " << detail::formatDouble(r.counters[c].median)
+                << ", \"" << name << "_mad\": " << detail::formatDouble(r.counters[c].mad);
+        }
+        if(r.ipc > 0.0) { out << ", \"ipc\": " << detail::formatDouble(r.ipc); }
+        out << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+
+inline void writeCsv(std::ostream& out, const std::vector<Result>& results)
+{
+    bool counters = false;
+    for(const Result& r : results) { counters |= r.hasCounters; }
+
+    out << "name,iterations,median_ns,mad_ns,median_cycles,mad_cycles,items_per_second,bytes_per_second";
+    for(size_t c=0; c<PERF_COUNTER_COUNT && counters; ++c)
+    {
+        out << ',' << perfCounterName(PerfCounter(c)) << ',' << perfCounterName(PerfCounter(c)) << "_mad";
+    }
+    out << (counters ? ",ipc\n" : "\n");
+    for(const Result& r : results)
+    {
+        // Names can't contain commas or quotes (they're C++ identifiers + numbers)
+        out << r.name << ',' << r.iterations
+            << ',' << detail::formatDouble(r.medianNs)
+            << ',' << detail::formatDouble(r.madNs)
+            << ',' << detail::formatDouble(r.medianCycles)
+            << ',' << detail::formatDouble(r.madCycles)
+            << ',' << detail::formatDouble(r.itemsPerSecond)
+            << ',' << detail::formatDouble(r.bytesPerSecond);
+        // Empty when unavailable
+        for(size_t c=0; c<PERF_COUNTER_COUNT && counters; ++c)
+        {
+            out << ',';
+            if(r.counters[c].available) { out << detail::formatDouble(r.counters[c].median); }
+            out << ',';
+            if(r.counters[c].available) { out << detail::formatDouble(r.counters[c].mad); }
+        }
+        if(counters)
+        {
+            out << ',';
+            if(r.ipc > 0.0) { out << detail::formatDouble(r.ipc); }
+        }
+        out << '\n';
+    }
+}
+
+
+namespace detail
+{
+
+// Just enough json parsing to read back what writeJson writes, returns name => samples
+inline bool readJsonSamples(const std::string& text, std::map<std::string, std::vector<double>>& out)
+{
+    size_t pos = 0;
+    const auto skipSpace = [&]{ while(pos < text.size() && std::isspace((unsigned char)text[pos])) { ++pos; } };
+    const auto readString = [&](std::string& value) -> bool
+    {
+        skipSpace();
+        if(pos >= text.size() || text[pos] != '"') { return false; }
+        ++pos;
+        value.clear();
+        while(pos < text.size() && text[pos] != '"')
+        {
+            if(text[pos] == '\\' && pos + 1 < text.size())
+            {
+                ++pos;
+                switch(text[pos])
+                {
+                    case 'n': value += '\n'; break;
+                    case 't': value += '\t'; break;
+                    case 'u': value += '?'; pos += 4; break;
+                    default:  value += text[pos]; break;
+                }
+                ++pos;
+                continue;
+            }
+            value += text[pos++];
+        }
+        ++pos;
+        return true;
+    };
+
+    const std::string key = "\"name\"";
+    for(;;)
+    {
+        pos = text.find(key, pos);
+        if(pos == std::string::npos) { return true; }
+        pos += key.size();
+        skipSpace();
+        if(pos >= text.size() || text[pos++] != ':') { return false; }
+        std::string name;
+        if(!readString(name)) { return false; }
+
+        const size_t objectEnd = text.find('}', pos);
+        const size_t samplesKey = text.find("\"samples_ns\"", pos);
+        if(samplesKey == std::string::npos || samplesKey > objectEnd) { return false; }
+        pos = text.find('[', samplesKey);
+        if(pos == std::string::npos) { return false; }
+        ++pos;
+
+        std::vector<double>& samples = out[name];
+        for(;;)
+        {
+            skipSpace();
+            if(pos >= text.size()) { return false; }
+            if(text[pos] == ']') { ++pos; break; }
+            if(text[pos] == ',') { ++pos; continue; }
+            char* end = nullptr;
+            const double value = std::strtod(text.c_str() + pos, &end);
+            if(end == text.c_str() + pos) { return false; }
+            samples.push_back(value);
+            pos = size_t(end - text.c_str());
+        }
+    }
+}
+
+
+// Two sided Mann-Whitney U test (normal approximation, with tie correction), returns the p-value
+inline double mannWhitneyU(const std::vector<double>& a, const std::vector<double>& b)
+{
+    const size_t n1 = a.size();
+    const size_t n2 = b.size();
+    if(n1 == 0 || n2 == 0) { return 1.0; }
+
+    std::vector<std::pair<double, int>> all;
+    all.reserve(n1 + n2);
+    for(double v : a) { all.emplace_back(v, 0); }
+    for(double v : b) { all.emplace_back(v, 1); }
+    std::sort(all.begin(), all.end());
+
+    // Average ranks over ties
+    double rankSumA = 0.0;
+    double tieCorrection = 0.0;
+    for(size_t i=0; i<all.size();)
+    {
+        size_t j = i;
+        while(j < all.size() && all[j].first == all[i].first) { ++j; }
+        const double rank = 0.5 * double(i + 1 + j);
+        const double ties = double(j - i);
+        tieCorrection += ties * ties * ties - ties;
+        for(size_t k=i; k<j; ++k)
+        {
+            if(all[k].second == 0) { rankSumA += rank; }
+        }
+        i = j;
+    }
+
+    const double N = double(n1 + n2);
+    const double u = rankSumA - double(n1) * double(n1 + 1) * 0.5;
+    const double mean = double(n1) * double(n2) * 0.5;
+    const double variance = double(n1) * double(n2) / 12.0 * ((N + 1.0) - tieCorrection / (N * (N - 1.0)));
+    if(variance <= 0.0) { return 1.0; }
+
+    // Continuity correction
+    const double z = (std::abs(u - mean) - 0.5) / std::sqrt(variance);
+    return std::erfc(std::max(z, 0.0) / std::sqrt(2.0));
+}
+
+inline bool readFile(const char* path, std::string& out)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file) { return false; }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    out = buffer.str();
+    return true;
+}
+
+} // namespace detail
+
+
+// Returns the number of regressions found, or -1 on error
+inline int compareResults(const char* basePath, const char* newPath, double alpha, double threshold, std::ostream& out)
+{
+    std::string baseText, newText;
+    std::map<std::string, std::vector<double>> baseSamples, newSamples;
+    if(!detail::readFile(basePath, baseText) || !detail::readJsonSamples(baseText, baseSamples))
+    {
+        out << "Failed to read " << basePath << "\n";
+        return -1;
+    }
+    if(!detail::readFile(newPath, newText) || !detail::readJsonSamples(newText, newSamples))
+    {
+        out << "Failed to read " << newPath << "\n";
+        return -1;
+    }
+
+    int regressions = 0;
+    char buffer[256];
+    std::snprintf(buffer, sizeof(buffer), "%-40s %12s %12s %9s %9s\n", "name", "base ns", "new ns", "change", "p");
+    out << buffer;
+    for(const auto& entry : newSamples)
+    {
+        const auto base = baseSamples.find(entry.first);
+        if(base == baseSamples.end())
+        {
+            continue;
+        }
+        const double baseMedian = detail::median(base->second);
+        const double newMedian = detail::median(entry.second);
+        const double change = baseMedian > 0.0 ? (newMedian - baseMedian) / baseMedian : 0.0;
+        const double p = detail::mannWhitneyU(base->second, entry.second);
+        const bool significant = (p < alpha) && (std::abs(change) > threshold);
+        const char* verdict = "";
+        if(significant)
+        {
+            verdict = change > 0.0 ? "REGRESSION" : "improvement";
+            regressions += change > 0.0;
+        }
+        std::snprintf(
+            buffer,
+            sizeof(buffer),
+            "%-40s %12.2f %12.2f %+8.1f%% %9.2g %s\n",
+            entry.first.c_str(),
+            baseMedian,
+            newMedian,
+            change * 100.0,
+            p,
+            verdict
+        );
+        out << buffer;
+    }
+    return regressions;
+}
+
+
+inline int runMain(int argc, char** argv)
+{
+    std::string filter;
+    std::string format = "console";
+    std::string outPath;
+    Options options;
+    double alpha = 0.01;
+    double threshold = 0.05;
+    const char* compareBase = nullptr;
+    const char* compareNew = nullptr;
+
+    for(int i=1; i<argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const auto value = [&](const char* prefix) -> const char*
+        {
+            const size_t length = std::strlen(prefix);
+            return arg.compare(0, length, prefix) == 0 ? argv[i] + length : nullptr;
+        };
+        if(const char* v = value("--filter=")) { filter = v; }
+        else if(const char* v = value("--format="))
+        {
+            format = v;
+            if(format != "console" && format != "json" && format != "csv")
+            {
+                std::cerr << "Unknown format: " << format << " (console, json or csv)\n";
+                return 2;
+            }
+        }
+        else if(const char* v = value("--out=")) { outPath = v; }
+        else if(const char* v = value("--budget-ms=")) { options.budgetMs = std::atof(v); }
+        else if(const char* v = value("--samples=")) { options.samples = uint32_t(std::max(std::atoi(v), 5)); }
+        else if(const char* v = value("--alpha=")) { alpha = std::atof(v); }
+        else if(const char* v = value("--threshold=")) { threshold = std::atof(v); }
+        else if(arg == "--counters") { options.counters = true; }
+        else if(arg == "--compare" && i + 2 < argc)
+        {
+            compareBase = argv[++i];
+            compareNew = argv[++i];
+        }
+        else
+        {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            return 2;
+        }
+    }
+
+    if(compareBase)
+    {
+        const int regressions = compareResults(compareBase, compareNew, alpha, threshold, std::cout);
+        return regressions < 0 ? 2 : (regressions > 0 ? 1 : 0);
+    }
+
+    std::ofstream file;
+    if(!outPath.empty())
+    {
+        file.open(outPath);
+        if(!file)
+        {
+            std::cerr << "Failed to open " << outPath << "\n";
+            return 2;
+        }
+    }
+    std::ostream& out = outPath.empty() ? std::cout : file;
+
+    // Console output is the progress output, otherwise progress goes to stderr
+    const bool console = format == "console";
+    const std::vector<Result> results = runBenchmarks(filter, options, console ? &out : &std::cerr);
+    if(format == "json") { writeJson(out, results); }
+    else if(format == "csv") { writeCsv(out, results); }
+    return 0;
+}
+
+} // namespace bench
+
+
+#define BENCH_CONCAT_IMPL(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_IMPL(a, b)
+
+#define BENCH(name, ...)                                                                    \
+    static void name(bench::State& state);                                                  \
+    [[maybe_unused]] static const bool BENCH_CONCAT(name, _benchRegistered) =               \
+        bench::detail::registerBenchmark(#name, name __VA_OPT__(,) __VA_ARGS__);            \
+    static void name([[maybe_unused]] bench::State& state)
+
+#define BENCH_MAIN()                                                                        \
+    int main(int argc, char** argv) { return bench::runMain(argc, argv); }
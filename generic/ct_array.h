@@ -203,7 +203,7 @@ template<typename Array, typename MaskArray>
 using get_masked_t = typename Array::template get_masked_t<MaskArray>;
 
 template<typename Array, auto predicate>
-using make_mask_t = typename Array::template get_masked_t<predicate>;
+using make_mask_t = typename Array::template make_mask_t<predicate>;
 
 template<typename Array, auto predicate>
 using filter_t = typename Array::template filter_t<predicate>;
@@ -521,7 +521,7 @@ template<typename Array, typename MaskArray>
 using get_masked_t = typename Array::template get_masked_t<MaskArray>;
 
 template<typename Array, auto predicate>
-using make_mask_t = typename Array::template get_masked_t<predicate>;
+using make_mask_t = typename Array::template make_mask_t<predicate>;
 
 template<typename Array, auto predicate>
 using filter_t = typename Array::template filter_t<predicate>;
@@ -665,7 +665,7 @@ struct ctt_array
     }
 
     template<typename FlagArray, typename Empty>
-    static RAPI_CONSTEXPRINLINE auto get_masked_helper()
+    static CONSTEXPRINLINE auto get_masked_helper()
     {
         static_assert(size() == FlagArray::size(), "Size mismatch!");
     
@@ -0,0 +1,429 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "bsf.h"
+#include "ct_array.h"
+#include "variadic_int_switch.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define CT_LOOKUP_HAS_SSE2 1
+    #include <emmintrin.h>
+#endif
+
+
+// Turns a ctv_array of keys (and optionally one of values) into a runtime lookup, picking
+// the table layout at compile time from the keys themselves, rather than a switch or a
+// std::unordered_map built at startup.
+//
+//     using Opcodes = ctva::ctv_array<uint16_t, 0x0100, 0x0204, 0x0310, 0x0422, 0x1000>;
+//     using Sizes   = ctva::ctv_array<uint8_t,  2,      4,      4,      8,      1>;
+//
+//     int index = ctva::lookup<Opcodes>::find(op);                 // Index into Opcodes, -1 if missing
+//     uint8_t size = ctva::lookup<Opcodes, Sizes>::get(op, 0);     // Sizes at that index, or the fallback
+//
+// Keys are integers or enums, and must be unique. Layouts, in the order they're tried:
+//
+//  * dense  - min -> max is filled in well enough (at most 4 * count + 16 slots, the same
+//             rule variadic_int_switch uses), one bounds check and one load.
+//  * linear - all the keys fit in 32 bytes (8 x int32, 16 x int16, 32 x int8), compared
+//             against the key at once with SSE2, the first match's lane is the index.
+//  * hashed - the perfect hash from variadic_int_switch (hash and displace), two multiply
+//             shifts, a displacement load and a slot load, then one key compare.
+//  * sorted - more than LOOKUP_MAX_HASHED_KEYS keys, where building the hash gets slow to
+//             compile. A branchless binary search, the loop is unrolled and each step is a
+//             cmov. Past ~2000 keys GCC's -fconstexpr-ops-limit runs out checking the keys
+//             are unique, whatever the layout.
+//
+// lookup<...>::strategy says which was picked, and lookup<...>::name() spells it out, e.g
+// for a static_assert, or to print next to a benchmark. A third template argument forces a
+// layout, e.g lookup<Keys, void, ctva::lookup_strategy::sorted>.
+//
+// find / contains / get are constexpr too, falling back to a plain loop at compile time.
+//
+// Random keys, half of them missing, against a hand written switch over the same keys
+// returning the index, each a non-inlined call (GCC 12, -O2), per lookup:
+//
+//                                  switch      find        get         forced sorted
+//     32 keys, 0 -> 31 (dense)     ~10ns       ~11ns       ~9ns        ~25ns
+//     8 x int32 (linear)           ~16ns       ~13ns       ~11ns       ~17ns
+//     16 x int16 (linear)          ~23ns       ~14ns       ~10ns       ~22ns
+//     64 x uint32 (hashed)         ~23ns       ~17ns       ~15ns       ~25ns
+//     512 x uint32 (hashed)        ~46ns       ~18ns       ~15ns       ~38ns
+//     1200 x uint64 (sorted)                   ~41ns
+//
+// The switches over sparse keys compile to a compare tree, which mispredicts on random
+// keys, a dense switch is the same jump / lookup table as the dense layout.
+//
+
+
+namespace ctva
+{
+
+enum class lookup_strategy {
+    automatic,
+    empty,
+    dense,
+    linear,
+    hashed,
+    sorted,
+};
+
+constexpr const char* lookup_strategy_name(lookup_strategy strategy) {
+    switch(strategy) {
+        case lookup_strategy::automatic:    return "automatic";
+        case lookup_strategy::empty:        return "empty";
+        case lookup_strategy::dense:        return "dense";
+        case lookup_strategy::linear:       return "linear";
+        case lookup_strategy::hashed:       return "hashed";
+        case lookup_strategy::sorted:       return "sorted";
+    }
+    return "unknown";
+}
+
+// The hash is built with a constexpr search which is roughly quadratic in the key count
+constexpr size_t LOOKUP_MAX_HASHED_KEYS = 1024;
+
+} // namespace ctva
+
+
+namespace detail::ct_lookup {
+
+template<typename T, bool = std::is_enum_v<T>>
+struct key_int {
+    using type = T;
+};
+
+template<typename T>
+struct key_int<T, true> {
+    using type = std::underlying_type_t<T>;
+};
+
+template<typename T>
+using key_int_t = typename key_int<T>::type;
+
+
+// Stands in for the values array when there are none
+struct no_values {
+    using element_type = int32_t;
+    static constexpr int32_t data[1] {};
+    static constexpr size_t size() { return 0; }
+};
+
+
+template<typename IntTypeT, IntTypeT... key_values>
+struct layout : variadic_int_switch_layout<IntTypeT, key_values...> {
+
+    using base = variadic_int_switch_layout<IntTypeT, key_values...>;
+    using base::count;
+
+    static constexpr std::array<IntTypeT, count> values {key_values...};
+
+    // Lanes in the two registers the SSE2 compare works on, 0 if the keys don't fit
+    static constexpr size_t simd_lanes() {
+#if defined(CT_LOOKUP_HAS_SSE2)
+        if(sizeof(IntTypeT) <= 4 && count * sizeof(IntTypeT) <= 32) {
+            return 32 / sizeof(IntTypeT);
+        }
+#endif
+        return 0;
+    }
+
+    static constexpr ctva::lookup_strategy pick() {
+        if(count == 0) {
+            return ctva::lookup_strategy::empty;
+        }
+        if(base::dense) {
+            return ctva::lookup_strategy::dense;
+        }
+        if(simd_lanes() != 0) {
+            return ctva::lookup_strategy::linear;
+        }
+        if(count <= ctva::LOOKUP_MAX_HASHED_KEYS) {
+            return ctva::lookup_strategy::hashed;
+        }
+        return ctva::lookup_strategy::sorted;
+    }
+
+
+    // Dense, (key - min) -> index, -1 where there's no key
+    static constexpr std::array<int32_t, base::span> make_dense() {
+        std::array<int32_t, base::span> table {};
+        for(int32_t& slot : table) {
+            slot = -1;
+        }
+        for(size_t i=0; i<count; ++i) {
+            table[size_t(base::keys[i] - base::min())] = int32_t(i);
+        }
+        return table;
+    }
+
+
+    // Linear, padded out to two registers with copies of the first key, which can only
+    // match where the first key itself does
+    struct alignas(16) padded {
+        IntTypeT keys[32 / sizeof(IntTypeT)];
+    };
+
+    static constexpr padded make_padded() {
+        padded result {};
+        for(size_t i=0; i<32 / sizeof(IntTypeT); ++i) {
+            result.keys[i] = values[i < count ? i : 0];
+        }
+        return result;
+    }
+
+
+    // Hashed, empty slots hold the first key, a lookup of which always goes to its own slot
+    template<typename ValueT>
+    struct hashed_slot {
+        IntTypeT    key;
+        int32_t     index;
+        ValueT      value;
+    };
+
+    template<typename ValueT>
+    struct hashed_table {
+        std::array<uint32_t, base::bucket_count>                displacements;
+        std::array<hashed_slot<ValueT>, base::slot_count>       slots;
+    };
+
+    template<typename ValueT, size_t value_count>
+    static constexpr hashed_table<ValueT> make_hashed(const ValueT (&value_data)[value_count]) {
+        constexpr typename base::hashed hashed = base::make_hashed();
+        hashed_table<ValueT> table {};
+        table.displacements = hashed.displacements;
+        for(size_t slot=0; slot<base::slot_count; ++slot) {
+            const int32_t index = hashed.cases[slot] >= 0 ? hashed.cases[slot] : 0;
+            table.slots[slot] = hashed_slot<ValueT>{
+                values[size_t(index)],
+                index,
+                value_data[value_count == count ? size_t(index) : 0]
+            };
+        }
+        return table;
+    }
+
+
+    // Sorted, keys ascending alongside where each came from
+    struct sorted_table {
+        std::array<IntTypeT, count> keys;
+        std::array<int32_t, count> indices;
+    };
+
+    static constexpr sorted_table make_sorted() {
+        std::array<std::pair<IntTypeT, int32_t>, count> pairs {};
+        for(size_t i=0; i<count; ++i) {
+            pairs[i] = {values[i], int32_t(i)};
+        }
+        std::sort(pairs.begin(), pairs.end());
+
+        sorted_table table {};
+        for(size_t i=0; i<count; ++i) {
+            table.keys[i] = pairs[i].first;
+            table.indices[i] = pairs[i].second;
+        }
+        return table;
+    }
+};
+
+
+#if defined(CT_LOOKUP_HAS_SSE2)
+
+template<typename IntTypeT>
+FORCEINLINE __m128i broadcast(IntTypeT key) {
+    if constexpr(sizeof(IntTypeT) == 1) {
+        return _mm_set1_epi8(char(key));
+    } else if constexpr(sizeof(IntTypeT) == 2) {
+        return _mm_set1_epi16(short(key));
+    } else {
+        return _mm_set1_epi32(int(key));
+    }
+}
+
+template<typename IntTypeT>
+FORCEINLINE __m128i compare(__m128i a, __m128i b) {
+    if constexpr(sizeof(IntTypeT) == 1) {
+        return _mm_cmpeq_epi8(a, b);
+    } else if constexpr(sizeof(IntTypeT) == 2) {
+        return _mm_cmpeq_epi16(a, b);
+    } else {
+        return _mm_cmpeq_epi32(a, b);
+    }
+}
+
+// One movemask bit per byte, so a lane's index is the first set bit / sizeof(IntTypeT)
+template<typename IntTypeT, size_t count>
+FORCEINLINE int simd_find(const IntTypeT* keys, IntTypeT key) {
+
+    const __m128i wanted = broadcast<IntTypeT>(key);
+    uint32_t mask = uint32_t(_mm_movemask_epi8(compare<IntTypeT>(_mm_load_si128((const __m128i*)keys), wanted)));
+    if constexpr(count * sizeof(IntTypeT) > 16) {
+        mask |= uint32_t(_mm_movemask_epi8(compare<IntTypeT>(_mm_load_si128((const __m128i*)keys + 1), wanted))) << 16;
+    }
+    return mask != 0 ? int(bsf(mask) / sizeof(IntTypeT)) : -1;
+}
+
+#endif
+
+
+// The tables, one struct per layout so only the one in use gets built (constexpr functions
+// can't hold statics before C++23)
+template<typename Layout>
+struct dense_table {
+    static constexpr auto table = Layout::make_dense();
+};
+
+template<typename Layout>
+struct padded_table {
+    static constexpr auto table = Layout::make_padded();
+};
+
+template<typename Layout, typename ValuesArray>
+struct hashed_table {
+    static constexpr auto table = Layout::template make_hashed<typename ValuesArray::element_type>(ValuesArray::data);
+};
+
+template<typename Layout>
+struct sorted_table {
+    static constexpr auto table = Layout::make_sorted();
+};
+
+} // namespace detail::ct_lookup
+
+
+namespace ctva
+{
+
+template<
+    typename Keys,
+    typename Values = void,
+    lookup_strategy Strategy = lookup_strategy::automatic
+>
+struct lookup;
+
+
+template<typename T, T... keys, typename Values, lookup_strategy Strategy>
+struct lookup<ctv_array<T, keys...>, Values, Strategy>
+{
+    static_assert(std::is_integral_v<T> || std::is_enum_v<T>, "lookup needs integer or enum keys");
+
+    using key_type = T;
+    using int_type = detail::ct_lookup::key_int_t<T>;
+    using layout = detail::ct_lookup::layout<int_type, int_type(keys)...>;
+    using values_array = std::conditional_t<std::is_void_v<Values>, detail::ct_lookup::no_values, Values>;
+    using value_type = typename values_array::element_type;
+
+    static_assert(std::is_void_v<Values> || values_array::size() == sizeof...(keys), "Need one value per key");
+
+    static constexpr lookup_strategy strategy = Strategy == lookup_strategy::automatic ? layout::pick() : Strategy;
+
+    static_assert(strategy != lookup_strategy::empty || sizeof...(keys) == 0, "Only empty key sets use the empty strategy");
+    static_assert(strategy != lookup_strategy::dense || layout::span <= (size_t(1) << 20), "Keys too spread out for a dense table");
+    static_assert(strategy != lookup_strategy::linear || sizeof...(keys) <= 64, "Too many keys for a linear search");
+
+    static constexpr size_t size() {
+        return sizeof...(keys);
+    }
+
+    static constexpr const char* name() {
+        return lookup_strategy_name(strategy);
+    }
+
+    // Index of key in Keys, -1 if it isn't one
+    static CONSTEXPRINLINE int find(const T key) {
+
+        const int_type value = int_type(key);
+
+        if(std::is_constant_evaluated()) {
+            for(size_t i=0; i<size(); ++i) {
+                if(layout::values[i] == value) {
+                    return int(i);
+                }
+            }
+            return -1;
+        }
+
+        if constexpr(strategy == lookup_strategy::empty) {
+            (void)value;
+            return -1;
+        }
+        else if constexpr(strategy == lookup_strategy::dense) {
+            constexpr const auto& table = detail::ct_lookup::dense_table<layout>::table;
+            const uint64_t offset = uint64_t(value) - layout::min();
+            return offset < layout::span ? table[offset] : -1;
+        }
+        else if constexpr(strategy == lookup_strategy::linear) {
+#if defined(CT_LOOKUP_HAS_SSE2)
+            if constexpr(layout::simd_lanes() != 0) {
+                constexpr const auto& table = detail::ct_lookup::padded_table<layout>::table;
+                return detail::ct_lookup::simd_find<int_type, size()>(table.keys, value);
+            }
+#endif
+            // Branchless, every key is compared and the first match wins
+            uint64_t mask = 0;
+            for(size_t i=0; i<size(); ++i) {
+                mask |= uint64_t(layout::values[i] == value) << i;
+            }
+            return mask != 0 ? int(bsf((unsigned long long)mask)) : -1;
+        }
+        else if constexpr(strategy == lookup_strategy::hashed) {
+            const auto& slot = hashed_slot(value);
+            return slot.key == value ? slot.index : -1;
+        }
+        else {
+            constexpr const auto& table = detail::ct_lookup::sorted_table<layout>::table;
+            const size_t position = sorted_position(table.keys.data(), value);
+            return table.keys[position] == value ? table.indices[position] : -1;
+        }
+    }
+
+    static CONSTEXPRINLINE bool contains(const T key) {
+        return find(key) != -1;
+    }
+
+    // The value at key's index in Values, otherwise fallback
+    static CONSTEXPRINLINE value_type get(const T key, const value_type fallback = value_type{}) {
+
+        static_assert(!std::is_void_v<Values>, "lookup<Keys>::get needs a Values array");
+
+        if constexpr(strategy == lookup_strategy::hashed) {
+            // The value sits in the slot, rather than one more dependent load
+            if(!std::is_constant_evaluated()) {
+                const auto& slot = hashed_slot(int_type(key));
+                return slot.key == int_type(key) ? slot.value : fallback;
+            }
+        }
+
+        const int index = find(key);
+        return index >= 0 ? values_array::data[index] : fallback;
+    }
+
+private:
+
+    static FORCEINLINE const auto& hashed_slot(const int_type value) {
+        constexpr const auto& table = detail::ct_lookup::hashed_table<layout, values_array>::table;
+        const uint64_t hashed = uint64_t(value);
+        const uint32_t displacement = table.displacements[layout::bucket_of(hashed)];
+        return table.slots[layout::slot_of(hashed, displacement)];
+    }
+
+    // The last key <= value (or the first key), each step halves what's left without a branch
+    static FORCEINLINE size_t sorted_position(const int_type* sorted, const int_type value) {
+        const int_type* first = sorted;
+        size_t remaining = size();
+        while(remaining > 1) {
+            const size_t half = remaining / 2;
+            first = first[half] <= value ? first + half : first;
+            remaining -= half;
+        }
+        return size_t(first - sorted);
+    }
+};
+
+} // namespace ctva
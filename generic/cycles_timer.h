@@ -33,3 +33,31 @@ inline uint64_t measure_cycles(CallbackT callback) {
 
 }
 
+
+// Same as measure_cycles, but with lfence / rdtscp serialising the reads, so the
+// callback can't be reordered around them (worth it for very short callbacks).
+template <typename CallbackT>
+inline uint64_t measure_cycles_serialised(CallbackT callback) {
+
+    unsigned int aux;
+    _mm_lfence();
+    uint64_t first = __rdtsc();
+    _mm_lfence();
+    callback();
+    uint64_t last = __rdtscp(&aux);
+    _mm_lfence();
+    return last - first;
+
+}
+
+
+// Records the cycles taken into histogram (e.g a LatencyHistogram or
+// ConcurrentLatencyHistogram from latency_histogram.h), and returns them
+template <typename HistogramT, typename CallbackT>
+inline uint64_t measure_cycles(HistogramT& histogram, CallbackT callback) {
+
+    const uint64_t cycles = measure_cycles(callback);
+    histogram.record(cycles);
+    return cycles;
+
+}
@@ -43,6 +43,7 @@
 /////////////////////////////
 // Things to put in a header
 
+#include <cstddef>
 #include <cstdint>
 
 // 0  => '0'
@@ -100,6 +101,18 @@ uint64_t    encodeNumber64(const int64_t x);
 inline uint32_t    encodeNumber32(const double x) { return encodeNumber32(float(x)); }
 inline uint64_t    encodeNumber64(const double x) { return encodeNumber64(float(x)); }
 
+
+// Batch versions, bit-identical to calling encodeNumber32/64 on each value.
+// With AVX2 8 values are done at a time, otherwise this is just a loop.
+// (~4x faster than the scalar version for mixed inputs)
+//
+// NB: GCC defaults to -ffp-contract=fast, which when targeting FMA will fuse the
+//     scaling and rounding steps of the scalar version (across statements), making
+//     its output depend on compiler flags. Use -ffp-contract=off if you rely on
+//     both matching.
+void        encodeNumbers32(const float* x, uint32_t* output, const size_t count);
+void        encodeNumbers64(const float* x, uint64_t* output, const size_t count);
+
 // Helper to stringify and visualize the value
 struct DecodedNumber32
 {
@@ -156,6 +169,10 @@ inline DecodedNumber64 stringifyEncodedNumber(const uint64_t data)
 #include <type_traits>
 #include <cstring>
 
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
 
 #if defined(_MSC_VER) && defined(_M_X64)
     #define ENC_FORCE_INLINE __forceinline
@@ -777,6 +794,328 @@ StorageT encodeNumber(const float x)
     return encodeWholeNumber<RepT>(x).get();
 }
 
+
+#if defined(__AVX2__)
+
+// 8 wide version of RepBuffer, u64 storage is split into lo and hi u32 halves.
+// Shifts are deliberately wrapped the same way x64 does for the scalar version,
+// so should things ever overflow the results would still match.
+template<typename StorageT>
+struct RepBufferX8
+{
+    const static uint32_t   capacity = 2 * sizeof(StorageT);
+
+    ENC_FORCE_INLINE void push(__m256i value, __m256i mask)
+    {
+        __m256i nibble = _mm256_andnot_si256(value, _mm256_set1_epi32(0b1111));
+        nibble = _mm256_and_si256(nibble, mask);
+        __m256i shift = _mm256_slli_epi32(_mm256_and_si256(index, _mm256_set1_epi32(capacity - 1)), 2);
+        lo = _mm256_or_si256(lo, _mm256_sllv_epi32(nibble, shift));
+        if constexpr(capacity == 16)
+        {
+            // Shifts < 32 wrap around to being huge, which sllv turns into 0
+            hi = _mm256_or_si256(hi, _mm256_sllv_epi32(nibble, _mm256_sub_epi32(shift, _mm256_set1_epi32(32))));
+        }
+        index = _mm256_sub_epi32(index, mask);
+    }
+
+    ENC_FORCE_INLINE void push(SpecialCharacters value, __m256i mask)
+    {
+        push(_mm256_set1_epi32(int(value)), mask);
+    }
+
+    ENC_FORCE_INLINE void pop(__m256i count, __m256i mask)
+    {
+        __m256i shift = _mm256_slli_epi32(_mm256_sub_epi32(count, index), 2);
+        shift = _mm256_and_si256(shift, _mm256_set1_epi32(capacity * 4 - 1));
+        const __m256i ones = _mm256_set1_epi32(-1);
+        if constexpr(capacity == 8)
+        {
+            lo = _mm256_and_si256(lo, _mm256_or_si256(_mm256_srlv_epi32(ones, shift), _mm256_xor_si256(mask, ones)));
+        }
+        else
+        {
+            __m256i loShift = _mm256_max_epi32(_mm256_sub_epi32(shift, _mm256_set1_epi32(32)), _mm256_setzero_si256());
+            lo = _mm256_and_si256(lo, _mm256_or_si256(_mm256_srlv_epi32(ones, loShift), _mm256_xor_si256(mask, ones)));
+            hi = _mm256_and_si256(hi, _mm256_or_si256(_mm256_srlv_epi32(ones, shift), _mm256_xor_si256(mask, ones)));
+        }
+        __m256i popped = _mm256_sub_epi32(index, _mm256_min_epu32(index, count));
+        index = _mm256_blendv_epi8(index, popped, mask);
+    }
+
+    ENC_FORCE_INLINE __m256i remainingSpace() const
+    {
+        return _mm256_sub_epi32(_mm256_set1_epi32(capacity), index);
+    }
+
+    __m256i     lo = _mm256_setzero_si256();
+    __m256i     hi = _mm256_setzero_si256();
+    __m256i     index = _mm256_setzero_si256();
+};
+
+
+ENC_FORCE_INLINE bool anyLanes(__m256i mask)
+{
+    return !_mm256_testz_si256(mask, mask);
+}
+
+
+ENC_FORCE_INLINE __m256i fpow10x8(__m256i n)
+{
+    // n > 38 clamps, n < -45 is 0
+    const __m256i tooSmall = _mm256_cmpgt_epi32(_mm256_set1_epi32(-45), n);
+    n = _mm256_min_epi32(_mm256_max_epi32(n, _mm256_set1_epi32(-45)), _mm256_set1_epi32(38));
+    __m256 p = _mm256_i32gather_ps(POW_10_LUT<float>, _mm256_add_epi32(n, _mm256_set1_epi32(45)), 4);
+    return _mm256_castps_si256(_mm256_andnot_ps(_mm256_castsi256_ps(tooSmall), p));
+}
+
+
+ENC_FORCE_INLINE __m256i approxFloorLog10x8(__m256 x)
+{
+    // For every exponent [-127, 128] the float product truncates to the same value as
+    // the double one, none of them land close enough to a whole number to matter.
+    __m256i e = _mm256_sub_epi32(
+        _mm256_and_si256(_mm256_srli_epi32(_mm256_castps_si256(x), 23), _mm256_set1_epi32(0xff)),
+        _mm256_set1_epi32(127)
+    );
+    __m256i approxLog10 = _mm256_cvttps_epi32(
+        _mm256_mul_ps(_mm256_cvtepi32_ps(e), _mm256_set1_ps(0.3010299956639811952137f))
+    );
+    __m256 ratio = _mm256_div_ps(x, _mm256_castsi256_ps(fpow10x8(approxLog10)));
+    __m256i lt = _mm256_castps_si256(_mm256_cmp_ps(ratio, _mm256_set1_ps(1.0f), _CMP_LT_OQ));
+    return _mm256_add_epi32(approxLog10, lt);
+}
+
+
+// Does floor+fract, *10 and pushes the digit for the lanes in mask, returns the digit.
+template<typename RepType>
+ENC_FORCE_INLINE __m256i pushNextDigitX8(__m256& x, RepType& output, __m256i mask)
+{
+    __m256 floored = _mm256_floor_ps(x);
+    __m256 next = _mm256_mul_ps(_mm256_sub_ps(x, floored), _mm256_set1_ps(10.0f));
+    x = _mm256_blendv_ps(x, next, _mm256_castsi256_ps(mask));
+    __m256i decimal = _mm256_cvttps_epi32(floored);
+    output.push(decimal, mask);
+    return decimal;
+}
+
+
+template<typename StorageT>
+ENC_FORCE_INLINE void encodeNumbersX8(const float* input, StorageT* output)
+{
+    using RepT = RepBuffer<StorageT>;
+    using RepX8 = RepBufferX8<StorageT>;
+    const uint32_t capacity = RepT::capacity;
+
+    const __m256 xSigned = _mm256_loadu_ps(input);
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    __m256 x = _mm256_andnot_ps(signMask, xSigned);
+
+    const __m256i ones = _mm256_set1_epi32(-1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i negative = _mm256_castps_si256(_mm256_cmp_ps(xSigned, _mm256_setzero_ps(), _CMP_LT_OQ));
+    const __m256i isZero = _mm256_castps_si256(_mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_EQ_OQ));
+    const __m256i isNan = _mm256_castps_si256(_mm256_cmp_ps(x, x, _CMP_UNORD_Q));
+    const __m256i isInf = _mm256_castps_si256(_mm256_cmp_ps(x, _mm256_set1_ps(INFINITY), _CMP_EQ_OQ));
+    const __m256i special = _mm256_or_si256(_mm256_or_si256(isZero, isNan), isInf);
+
+    // requiresEngineerNotation
+    __m256i engNotation;
+    {
+        const __m256 bigSide = _mm256_blendv_ps(
+            _mm256_set1_ps(ctpow10<int32_t(capacity), float>()),
+            _mm256_set1_ps(ctpow10<int32_t(capacity-1), float>()),
+            _mm256_castsi256_ps(negative)
+        );
+        const __m256 smallSide = _mm256_blendv_ps(
+            _mm256_set1_ps(ctpow10<-2, float>()),
+            _mm256_set1_ps(ctpow10<-3, float>()),
+            _mm256_castsi256_ps(negative)
+        );
+        const __m256i fits = _mm256_castps_si256(_mm256_and_ps(
+            _mm256_cmp_ps(x, bigSide, _CMP_LT_OQ),
+            _mm256_cmp_ps(x, smallSide, _CMP_GE_OQ)
+        ));
+        engNotation = _mm256_andnot_si256(_mm256_or_si256(fits, special), ones);
+    }
+    __m256i wholeNumber = _mm256_andnot_si256(_mm256_or_si256(engNotation, special), ones);
+
+    RepX8 buf;
+
+    // Common to both
+    buf.push(SpecialCharacters::NEG, _mm256_andnot_si256(special, negative));
+    __m256i e10 = approxFloorLog10x8(x);
+    x = _mm256_mul_ps(x, _mm256_castsi256_ps(fpow10x8(_mm256_sub_epi32(zero, e10))));
+
+    // encodeWholeNumber
+    if(anyLanes(wholeNumber))
+    {
+        const __m256i isWhole = _mm256_castps_si256(_mm256_cmp_ps(_mm256_floor_ps(_mm256_andnot_ps(signMask, xSigned)),
+                                                                  _mm256_andnot_ps(signMask, xSigned),
+                                                                  _CMP_EQ_OQ));
+        __m256 xw = _mm256_add_ps(
+            x,
+            _mm256_mul_ps(
+                _mm256_set1_ps(0.5f),
+                _mm256_castsi256_ps(fpow10x8(_mm256_add_epi32(_mm256_sub_epi32(zero, buf.remainingSpace()), _mm256_set1_epi32(2))))
+            )
+        );
+        __m256i e10w = e10;
+
+        const __m256i roundedUp = _mm256_castps_si256(_mm256_cmp_ps(xw, _mm256_set1_ps(10.0f), _CMP_GE_OQ));
+        xw = _mm256_blendv_ps(xw, _mm256_mul_ps(xw, _mm256_set1_ps(0.1f)), _mm256_castsi256_ps(roundedUp));
+        e10w = _mm256_sub_epi32(e10w, roundedUp);
+
+        // Numbers >= 1
+        const __m256i aboveOne = _mm256_and_si256(wholeNumber, _mm256_cmpgt_epi32(e10w, _mm256_set1_epi32(-1)));
+        for(int32_t i=0; ; ++i)
+        {
+            __m256i active = _mm256_and_si256(aboveOne, _mm256_cmpgt_epi32(e10w, _mm256_set1_epi32(i - 1)));
+            if(!anyLanes(active)) { break; }
+            pushNextDigitX8(xw, buf, active);
+        }
+
+        const __m256i finished = _mm256_and_si256(
+            aboveOne,
+            _mm256_or_si256(isWhole, _mm256_cmpgt_epi32(_mm256_set1_epi32(2), buf.remainingSpace()))
+        );
+
+        // Decimals
+        const __m256i decimals = _mm256_andnot_si256(finished, wholeNumber);
+        if(anyLanes(decimals))
+        {
+            __m256i writtenZeroes = _mm256_set1_epi32(1);
+            buf.push(SpecialCharacters::DOT, decimals);
+
+            const __m256i leadingZeroes = _mm256_sub_epi32(_mm256_sub_epi32(zero, e10w), _mm256_set1_epi32(1));
+            for(int32_t i=0; ; ++i)
+            {
+                __m256i active = _mm256_and_si256(decimals, _mm256_cmpgt_epi32(leadingZeroes, _mm256_set1_epi32(i)));
+                if(!anyLanes(active)) { break; }
+                buf.push(zero, active);
+                writtenZeroes = _mm256_sub_epi32(writtenZeroes, active);
+            }
+
+            const __m256i budget = buf.remainingSpace();
+            for(int32_t i=0; ; ++i)
+            {
+                __m256i active = _mm256_and_si256(decimals, _mm256_cmpgt_epi32(budget, _mm256_set1_epi32(i)));
+                if(!anyLanes(active)) { break; }
+                __m256i decimal = pushNextDigitX8(xw, buf, active);
+                __m256i incremented = _mm256_and_si256(
+                    _mm256_sub_epi32(writtenZeroes, ones),
+                    _mm256_cmpeq_epi32(decimal, zero)
+                );
+                writtenZeroes = _mm256_blendv_epi8(writtenZeroes, incremented, active);
+            }
+
+            buf.pop(writtenZeroes, decimals);
+        }
+    }
+
+    // encodeEngNotation
+    if(anyLanes(engNotation))
+    {
+        __m256i budget = _mm256_sub_epi32(buf.remainingSpace(), _mm256_set1_epi32(5));
+        budget = _mm256_add_epi32(budget, _mm256_cmpgt_epi32(_mm256_abs_epi32(e10), _mm256_set1_epi32(9)));
+
+        __m256 xe = _mm256_add_ps(
+            x,
+            _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_castsi256_ps(fpow10x8(_mm256_sub_epi32(zero, budget))))
+        );
+        __m256i e10e = e10;
+
+        const __m256i roundedUp = _mm256_castps_si256(_mm256_cmp_ps(xe, _mm256_set1_ps(10.0f), _CMP_GE_OQ));
+        xe = _mm256_blendv_ps(xe, _mm256_mul_ps(xe, _mm256_set1_ps(0.1f)), _mm256_castsi256_ps(roundedUp));
+        e10e = _mm256_sub_epi32(e10e, roundedUp);
+        budget = _mm256_add_epi32(
+            budget,
+            _mm256_and_si256(roundedUp, _mm256_cmpeq_epi32(e10e, _mm256_set1_epi32(10)))
+        );
+
+        // First number and a dot
+        pushNextDigitX8(xe, buf, engNotation);
+        buf.push(SpecialCharacters::DOT, engNotation);
+
+        for(int32_t i=0; ; ++i)
+        {
+            __m256i active = _mm256_and_si256(engNotation, _mm256_cmpgt_epi32(budget, _mm256_set1_epi32(i)));
+            if(!anyLanes(active)) { break; }
+            pushNextDigitX8(xe, buf, active);
+        }
+
+        const __m256i negativeExponent = _mm256_cmpgt_epi32(zero, e10e);
+        buf.push(SpecialCharacters::E, engNotation);
+        buf.push(
+            _mm256_blendv_epi8(
+                _mm256_set1_epi32(int(SpecialCharacters::PLUS)),
+                _mm256_set1_epi32(int(SpecialCharacters::NEG)),
+                negativeExponent
+            ),
+            engNotation
+        );
+
+        // x * 205 >> 11 == x / 10 for x < 1029
+        const __m256i exponent = _mm256_abs_epi32(e10e);
+        const __m256i tens = _mm256_srli_epi32(_mm256_mullo_epi32(exponent, _mm256_set1_epi32(205)), 11);
+        const __m256i units = _mm256_sub_epi32(exponent, _mm256_mullo_epi32(tens, _mm256_set1_epi32(10)));
+        buf.push(tens, _mm256_and_si256(engNotation, _mm256_cmpgt_epi32(exponent, _mm256_set1_epi32(9))));
+        buf.push(units, engNotation);
+    }
+
+    // Specials, NB: the buffers are stored inverted
+    const StorageT zeroValue = RepT::getZero();
+    const StorageT nanValue = RepT::getNan();
+    const StorageT posInfValue = RepT::getPosInf();
+    const StorageT negInfValue = RepT::getNegInf();
+
+    const __m256i negInf = _mm256_and_si256(isInf, negative);
+    const __m256i posInf = _mm256_andnot_si256(negative, isInf);
+
+    __m256i lo = _mm256_xor_si256(buf.lo, ones);
+    lo = _mm256_blendv_epi8(lo, _mm256_set1_epi32(uint32_t(zeroValue)), isZero);
+    lo = _mm256_blendv_epi8(lo, _mm256_set1_epi32(uint32_t(nanValue)), isNan);
+    lo = _mm256_blendv_epi8(lo, _mm256_set1_epi32(uint32_t(posInfValue)), posInf);
+    lo = _mm256_blendv_epi8(lo, _mm256_set1_epi32(uint32_t(negInfValue)), negInf);
+
+    if constexpr(capacity == 8)
+    {
+        _mm256_storeu_si256((__m256i*)output, lo);
+    }
+    else
+    {
+        __m256i hi = _mm256_xor_si256(buf.hi, ones);
+        hi = _mm256_blendv_epi8(hi, _mm256_set1_epi32(uint32_t(zeroValue >> 32)), isZero);
+        hi = _mm256_blendv_epi8(hi, _mm256_set1_epi32(uint32_t(nanValue >> 32)), isNan);
+        hi = _mm256_blendv_epi8(hi, _mm256_set1_epi32(uint32_t(posInfValue >> 32)), posInf);
+        hi = _mm256_blendv_epi8(hi, _mm256_set1_epi32(uint32_t(negInfValue >> 32)), negInf);
+
+        const __m256i a = _mm256_unpacklo_epi32(lo, hi);
+        const __m256i b = _mm256_unpackhi_epi32(lo, hi);
+        _mm256_storeu_si256((__m256i*)output, _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i*)(output + 4), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+}
+
+#endif
+
+
+template<typename StorageT>
+void encodeNumbers(const float* x, StorageT* output, const size_t count)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for(; i + 8 <= count; i += 8)
+    {
+        encodeNumbersX8<StorageT>(x + i, output + i);
+    }
+#endif
+    for(; i < count; ++i)
+    {
+        output[i] = encodeNumber<StorageT>(x[i]);
+    }
+}
+
 } // unnamed namespace
 
 
@@ -802,3 +1141,8 @@ uint64_t    encodeNumber64(const uint32_t x) { return encodeNumber<uint64_t>(x);
 uint64_t    encodeNumber64(const int32_t x) { return encodeNumber<uint64_t>(x); }
 uint64_t    encodeNumber64(const uint64_t x) { return encodeNumber<uint64_t>(x); }
 uint64_t    encodeNumber64(const int64_t x) { return encodeNumber<uint64_t>(x); }
+
+
+// Batch versions
+void        encodeNumbers32(const float* x, uint32_t* output, const size_t count) { encodeNumbers<uint32_t>(x, output, count); }
+void        encodeNumbers64(const float* x, uint64_t* output, const size_t count) { encodeNumbers<uint64_t>(x, output, count); }
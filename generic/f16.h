@@ -1,9 +1,299 @@
 #pragma once
 
+#include <bit>
+#include <cstddef>
 #include <cstdint>
 
+// F16C is implied by AVX2 on anything MSVC will target, but it doesn't define __F16C__
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+    #define F16_HAS_F16C 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #define F16_HAS_SSE2 1
+#endif
+
+#if defined(F16_HAS_F16C) || defined(F16_HAS_SSE2)
+    #include <immintrin.h>
+#endif
+
+
+// Conversion and helpers for IEEE half floats, stored as uint16_t.
+//
+// The software conversions are bit exact with F16C (round to nearest even, denormals
+// handled, NaNs quietened with their top mantissa bits kept), so results don't change
+// depending on which path gets taken.
+// They're based off Fabian Giesen's float_to_half_fast3_rtne / half_to_float_fast5 and
+// both rely on the default rounding mode, with FTZ / DAZ disabled.
+//
+// Verified against vcvtps2ph for all 2^32 floats and vcvtph2ps for all 65536 halfs.
+//
+// Bulk speed, GB/s of input (1x core, 32KB of halfs / 64KB of floats, in cache):
+//
+//                      AVX2 + F16C     SSE2 only
+//  f32_to_f16          ~25             ~0.6
+//  f16_to_f32          ~7              ~0.6
+//  f16_min_max         ~7              ~3
+//  f16_all_in_range    ~7              ~3
+//
+// f16_min_max / f16_all_in_range work directly on the half bits, by mapping them to
+// int16s which have the same ordering, so never need to expand to floats.
+//
+// uint16_t  h[N];
+// float     f[N];
+// f32_to_f16(f, h, N);
+// f16_to_f32(h, f, N);
+//
+// f16_min_max_result r = f16_min_max(h, N);
+// if (r.valid) { float lo = f16_to_f32(r.min); ... }
+//
+// if (!f16_all_in_range(h, N, 0x0000, 0x3c00)) { /* something outside [0, 1] */ }
+//
+
 
 inline bool f16_between_0_and_1(const uint16_t value) {
     return value <= 0x3c00;
 }
 
+
+inline uint16_t f32_to_f16(const float value) {
+    uint32_t x = std::bit_cast<uint32_t>(value);
+    const uint32_t sign = x & 0x80000000u;
+    x ^= sign;
+
+    uint32_t result;
+
+    // Inf or NaN (values in [65520, 65536) round to inf via the normal path)
+    if (x >= 0x47800000u) {
+        result = (x > 0x7f800000u) ? (0x7e00u | ((x >> 13) & 0x3ffu)) : 0x7c00u;
+    }
+    // Denormal / zero, let the FPU do the rounding by aligning the 10bits of mantissa
+    // at the bottom of a float with an exponent of 0.5.
+    else if (x < 0x38800000u) {
+        const float aligned = std::bit_cast<float>(x) + 0.5f;
+        result = std::bit_cast<uint32_t>(aligned) - 0x3f000000u;
+    }
+    else {
+        const uint32_t mantissa_odd = (x >> 13) & 1u;
+        x += 0xc8000fffu;  // ((15 - 127) << 23) + 0xfff
+        x += mantissa_odd;
+        result = x >> 13;
+    }
+
+    return uint16_t((sign >> 16) | result);
+}
+
+
+inline float f16_to_f32(const uint16_t value) {
+    const uint32_t shifted_exponent = 0x7c00u << 13;
+    uint32_t x = (uint32_t(value) & 0x7fffu) << 13;
+    const uint32_t exponent = x & shifted_exponent;
+
+    x += (127 - 15) << 23;
+
+    // Inf / NaN
+    if (exponent == shifted_exponent) {
+        x += (128 - 16) << 23;
+        x |= (x & 0x7fffffu) ? 0x400000u : 0u;
+    }
+    // Denormal / zero, renormalize via the FPU
+    else if (exponent == 0) {
+        x += 1 << 23;
+        x = std::bit_cast<uint32_t>(std::bit_cast<float>(x) - std::bit_cast<float>(113u << 23));
+    }
+
+    return std::bit_cast<float>(x | ((uint32_t(value) & 0x8000u) << 16));
+}
+
+
+inline void f32_to_f16(const float* input, uint16_t* output, const size_t count) {
+    size_t i = 0;
+#if defined(F16_HAS_F16C)
+    for(; i + 8 <= count; i += 8) {
+        const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(input + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)(output + i), h);
+    }
+#endif
+    for(; i < count; ++i) {
+        output[i] = f32_to_f16(input[i]);
+    }
+}
+
+
+inline void f16_to_f32(const uint16_t* input, float* output, const size_t count) {
+    size_t i = 0;
+#if defined(F16_HAS_F16C)
+    for(; i + 8 <= count; i += 8) {
+        const __m128i h = _mm_loadu_si128((const __m128i*)(input + i));
+        _mm256_storeu_ps(output + i, _mm256_cvtph_ps(h));
+    }
+#endif
+    for(; i < count; ++i) {
+        output[i] = f16_to_f32(input[i]);
+    }
+}
+
+
+// Maps a half onto an int16 with the same ordering, -0 sorts just below +0.
+// NaNs need filtering out before this.
+inline int16_t f16_ordered_key(const uint16_t value) {
+    const uint16_t negative_mask = uint16_t(int16_t(value) >> 15);
+    return int16_t(value ^ (negative_mask & 0x7fffu));
+}
+
+
+// Same, but ordered by value, -0 and +0 are both 0 (so there's no going back to the half).
+inline int16_t f16_value_key(const uint16_t value) {
+    const int16_t magnitude = int16_t(value & 0x7fffu);
+    return (value & 0x8000u) ? int16_t(-magnitude) : magnitude;
+}
+
+
+inline bool f16_is_nan(const uint16_t value) {
+    return (value & 0x7fffu) > 0x7c00u;
+}
+
+
+struct f16_min_max_result {
+    uint16_t min;
+    uint16_t max;
+    bool     valid;     // false if there were no non NaN values
+};
+
+
+// NaNs are ignored (like fmin / fmax), -0 is treated as being less than +0
+inline f16_min_max_result f16_min_max(const uint16_t* data, const size_t count) {
+    int32_t min_key = INT16_MAX;
+    int32_t max_key = INT16_MIN;
+    bool any_valid = false;
+    size_t i = 0;
+
+#if defined(F16_HAS_SSE2)
+    {
+    #if defined(__AVX2__)
+        __m256i min8 = _mm256_set1_epi16(INT16_MAX);
+        __m256i max8 = _mm256_set1_epi16(INT16_MIN);
+        __m256i any8 = _mm256_setzero_si256();
+        for(; i + 16 <= count; i += 16) {
+            const __m256i h = _mm256_loadu_si256((const __m256i*)(data + i));
+            const __m256i abs = _mm256_and_si256(h, _mm256_set1_epi16(0x7fff));
+            const __m256i nan = _mm256_cmpgt_epi16(abs, _mm256_set1_epi16(0x7c00));
+            const __m256i key = _mm256_xor_si256(h, _mm256_and_si256(_mm256_srai_epi16(h, 15), _mm256_set1_epi16(0x7fff)));
+            // NaNs become INT16_MAX for min and INT16_MIN for max, so they never win
+            min8 = _mm256_min_epi16(min8, _mm256_or_si256(_mm256_andnot_si256(nan, key), _mm256_and_si256(nan, _mm256_set1_epi16(INT16_MAX))));
+            max8 = _mm256_max_epi16(max8, _mm256_or_si256(_mm256_andnot_si256(nan, key), _mm256_and_si256(nan, _mm256_set1_epi16(INT16_MIN))));
+            any8 = _mm256_or_si256(any8, _mm256_andnot_si256(nan, _mm256_set1_epi16(-1)));
+        }
+        __m128i min4 = _mm_min_epi16(_mm256_castsi256_si128(min8), _mm256_extracti128_si256(min8, 1));
+        __m128i max4 = _mm_max_epi16(_mm256_castsi256_si128(max8), _mm256_extracti128_si256(max8, 1));
+        __m128i any4 = _mm_or_si128(_mm256_castsi256_si128(any8), _mm256_extracti128_si256(any8, 1));
+    #else
+        __m128i min4 = _mm_set1_epi16(INT16_MAX);
+        __m128i max4 = _mm_set1_epi16(INT16_MIN);
+        __m128i any4 = _mm_setzero_si128();
+    #endif
+        for(; i + 8 <= count; i += 8) {
+            const __m128i h = _mm_loadu_si128((const __m128i*)(data + i));
+            const __m128i abs = _mm_and_si128(h, _mm_set1_epi16(0x7fff));
+            const __m128i nan = _mm_cmpgt_epi16(abs, _mm_set1_epi16(0x7c00));
+            const __m128i key = _mm_xor_si128(h, _mm_and_si128(_mm_srai_epi16(h, 15), _mm_set1_epi16(0x7fff)));
+            min4 = _mm_min_epi16(min4, _mm_or_si128(_mm_andnot_si128(nan, key), _mm_and_si128(nan, _mm_set1_epi16(INT16_MAX))));
+            max4 = _mm_max_epi16(max4, _mm_or_si128(_mm_andnot_si128(nan, key), _mm_and_si128(nan, _mm_set1_epi16(INT16_MIN))));
+            any4 = _mm_or_si128(any4, _mm_andnot_si128(nan, _mm_set1_epi16(-1)));
+        }
+
+        alignas(16) int16_t mins[8], maxs[8];
+        _mm_store_si128((__m128i*)mins, min4);
+        _mm_store_si128((__m128i*)maxs, max4);
+        for(int j = 0; j < 8; ++j) {
+            min_key = mins[j] < min_key ? mins[j] : min_key;
+            max_key = maxs[j] > max_key ? maxs[j] : max_key;
+        }
+        any_valid = _mm_movemask_epi8(any4) != 0;
+    }
+#endif
+
+    for(; i < count; ++i) {
+        if (f16_is_nan(data[i])) {
+            continue;
+        }
+        const int32_t key = f16_ordered_key(data[i]);
+        min_key = key < min_key ? key : min_key;
+        max_key = key > max_key ? key : max_key;
+        any_valid = true;
+    }
+
+    f16_min_max_result result;
+    // The mapping is its own inverse
+    result.min = uint16_t(f16_ordered_key(uint16_t(min_key)));
+    result.max = uint16_t(f16_ordered_key(uint16_t(max_key)));
+    result.valid = any_valid;
+    return result;
+}
+
+
+// True if every value is within [low, high] (inclusive, compared as halfs not bits, so -0 is
+// in [+0, x]), NaNs count as being out of range.
+inline bool f16_all_in_range(const uint16_t* data, const size_t count, const uint16_t low, const uint16_t high) {
+    const int16_t low_key = f16_value_key(low);
+    const int16_t high_key = f16_value_key(high);
+    size_t i = 0;
+
+#if defined(F16_HAS_SSE2)
+    #if defined(__AVX2__)
+    {
+        const __m256i lo8 = _mm256_set1_epi16(low_key);
+        const __m256i hi8 = _mm256_set1_epi16(high_key);
+        __m256i bad8 = _mm256_setzero_si256();
+        for(; i + 16 <= count; i += 16) {
+            const __m256i h = _mm256_loadu_si256((const __m256i*)(data + i));
+            const __m256i abs = _mm256_and_si256(h, _mm256_set1_epi16(0x7fff));
+            const __m256i sign = _mm256_srai_epi16(h, 15);
+            const __m256i key = _mm256_sub_epi16(_mm256_xor_si256(abs, sign), sign);
+            bad8 = _mm256_or_si256(bad8, _mm256_cmpgt_epi16(abs, _mm256_set1_epi16(0x7c00)));
+            bad8 = _mm256_or_si256(bad8, _mm256_cmpgt_epi16(lo8, key));
+            bad8 = _mm256_or_si256(bad8, _mm256_cmpgt_epi16(key, hi8));
+            // Bail out early every 1KB or so
+            if (((i & 511) == 0) && !_mm256_testz_si256(bad8, bad8)) {
+                return false;
+            }
+        }
+        if (!_mm256_testz_si256(bad8, bad8)) {
+            return false;
+        }
+    }
+    #endif
+    {
+        const __m128i lo4 = _mm_set1_epi16(low_key);
+        const __m128i hi4 = _mm_set1_epi16(high_key);
+        __m128i bad4 = _mm_setzero_si128();
+        for(; i + 8 <= count; i += 8) {
+            const __m128i h = _mm_loadu_si128((const __m128i*)(data + i));
+            const __m128i abs = _mm_and_si128(h, _mm_set1_epi16(0x7fff));
+            const __m128i sign = _mm_srai_epi16(h, 15);
+            const __m128i key = _mm_sub_epi16(_mm_xor_si128(abs, sign), sign);
+            bad4 = _mm_or_si128(bad4, _mm_cmpgt_epi16(abs, _mm_set1_epi16(0x7c00)));
+            bad4 = _mm_or_si128(bad4, _mm_cmpgt_epi16(lo4, key));
+            bad4 = _mm_or_si128(bad4, _mm_cmpgt_epi16(key, hi4));
+            if (((i & 511) == 0) && _mm_movemask_epi8(bad4)) {
+                return false;
+            }
+        }
+        if (_mm_movemask_epi8(bad4)) {
+            return false;
+        }
+    }
+#endif
+
+    for(; i < count; ++i) {
+        if (f16_is_nan(data[i])) {
+            return false;
+        }
+        const int16_t key = f16_value_key(data[i]);
+        if ((key < low_key) || (key > high_key)) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+// Declares a family of specialised kernels once, with only an allowed subset of the
+// permutations being instantiated, everything else going to a generic runtime-branching
+// kernel. Builds on variadic_range_dispatch.h (axes + index layout) and ct_array.h
+// (filter_t, to pick the permutations).
+//
+// Example usage:
+//
+//    struct BlurKernels
+//    {
+//        using Axes = kernel_registry::Axes<
+//            variadic_dispatch::Range<Format, Format::R8, Format::RGBA32F>,
+//            variadic_dispatch::Range<int, 1, 4>,        // Radius
+//            kernel_registry::Flag                       // Wrap
+//        >;
+//        using Signature = void(const Image&, Image&);
+//
+//        // Which permutations are worth their own instantiation, must be constexpr
+//        static constexpr bool allowed(Format format, int radius, bool wrap)
+//        {
+//            return format != Format::RGBA32F && (radius == 1 || radius == 2);
+//        }
+//
+//        template<Format format, int radius, bool wrap>
+//        static void run(const Image& in, Image& out) { ... }
+//
+//        static void generic(Format format, int radius, bool wrap, const Image& in, Image& out) { ... }
+//
+//        // Optional, fails the build if allowed() lets more than this through
+//        static constexpr int32_t maxInstantiations = 8;
+//    };
+//
+//    kernel_registry::dispatch<BlurKernels>(format, radius, wrap, in, out);
+//
+// Out of range values also go to generic. Unlike variadic_dispatch::dispatch the table
+// lives with the family rather than each call site, so every call site shares the one
+// set of instantiations.
+//
+// Family<K>::totalCount / instantiatedCount are available at compile time, and each
+// permutation is its own function (kernel_registry::detail::...::specialised<index>),
+// so the per permutation code size can be read straight out of the binary:
+//
+//    nm -C -S --size-sort app | grep 'kernel_registry::detail'
+//
+// Family<K>::describe(index, callback) gives back the axis values for an index.
+//
+
+#include "ct_array.h"
+#include "variadic_range_dispatch.h"
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+
+namespace kernel_registry
+{
+
+using Flag = variadic_dispatch::Range<bool, false, true>;
+
+template<typename... Ranges>
+using Axes = ctta::ctt_array<Ranges...>;
+
+
+namespace detail
+{
+
+template<typename T, T start, T end>
+T rangeTypeHelper(variadic_dispatch::Range<T, start, end>);
+
+template<typename Range>
+using RangeType = decltype(rangeTypeHelper(Range{}));
+
+template<int32_t... indices>
+ctva::ctv_array<int32_t, indices...> iotaHelper(std::integer_sequence<int32_t, indices...>);
+
+template<int32_t count>
+using Iota = decltype(iotaHelper(std::make_integer_sequence<int32_t, count>{}));
+
+template<typename Kernels>
+constexpr int32_t maxInstantiations()
+{
+    if constexpr(requires { Kernels::maxInstantiations; })
+    {
+        return Kernels::maxInstantiations;
+    }
+    else
+    {
+        return INT32_MAX;
+    }
+}
+
+
+template<typename Kernels, typename Signature, typename Strides, typename AxesArray>
+struct FamilyImpl;
+
+template<typename Kernels, typename R, typename... Args, int32_t... strides, typename... Ranges>
+struct FamilyImpl<Kernels, R(Args...), std::integer_sequence<int32_t, strides...>, ctta::ctt_array<Ranges...>>
+{
+    using Function = R(*)(RangeType<Ranges>..., Args...);
+
+    static constexpr int32_t totalCount = variadic_dispatch::detail::DispatcherImpl<Ranges...>::strideData.totalSize;
+
+    static constexpr bool allowedIndex(int32_t index)
+    {
+        return Kernels::allowed(RangeType<Ranges>((index / strides) % Ranges::size + Ranges::start)...);
+    }
+
+    // Flat indices (same layout as variadic_dispatch) of the permutations which get instantiated
+    using Instantiated = ctva::filter_t<Iota<totalCount>, [](int32_t index){ return allowedIndex(index); }>;
+
+    static constexpr int32_t instantiatedCount = int32_t(Instantiated::size());
+
+    static_assert(instantiatedCount <= maxInstantiations<Kernels>(), "Kernel family instantiates more permutations than its maxInstantiations");
+
+    template<int32_t index>
+    static R specialised(RangeType<Ranges>..., Args... args)
+    {
+        return Kernels::template run<Ranges::template Dispatchable<strides>::template value<index>...>(std::forward<Args>(args)...);
+    }
+
+    static R generic(RangeType<Ranges>... values, Args... args)
+    {
+        return Kernels::generic(values..., std::forward<Args>(args)...);
+    }
+
+    template<int32_t... indices>
+    static constexpr std::array<Function, totalCount> makeTable(ctva::ctv_array<int32_t, indices...>)
+    {
+        std::array<Function, totalCount> result {};
+        for(Function& function : result)
+        {
+            function = &generic;
+        }
+        ((result[indices] = &specialised<indices>), ...);
+        return result;
+    }
+
+    static constexpr std::array<Function, totalCount> table = makeTable(Instantiated{});
+
+    static R call(RangeType<Ranges>... values, Args... args)
+    {
+        const bool allInBounds = (Ranges::template Dispatchable<strides>::inBounds(values) && ...);
+        if(!allInBounds) [[unlikely]]
+        {
+            return Kernels::generic(values..., std::forward<Args>(args)...);
+        }
+        const int32_t index = (Ranges::template Dispatchable<strides>::index(values) + ...);
+        return table[index](values..., std::forward<Args>(args)...);
+    }
+
+    static constexpr bool isInstantiated(RangeType<Ranges>... values)
+    {
+        const bool allInBounds = (Ranges::template Dispatchable<strides>::inBounds(values) && ...);
+        return allInBounds && allowedIndex((Ranges::template Dispatchable<strides>::index(values) + ...));
+    }
+
+    // callback(values...) with the axis values of a flat index
+    template<typename Callback>
+    static constexpr void describe(int32_t index, Callback&& callback)
+    {
+        callback(RangeType<Ranges>((index / strides) % Ranges::size + Ranges::start)...);
+    }
+};
+
+template<typename... Ranges>
+using Strides = typename variadic_dispatch::detail::DispatcherImpl<Ranges...>::Strides;
+
+template<typename Kernels, typename AxesArray>
+struct FamilyFor;
+
+template<typename Kernels, typename... Ranges>
+struct FamilyFor<Kernels, ctta::ctt_array<Ranges...>>
+{
+    using type = FamilyImpl<Kernels, typename Kernels::Signature, Strides<Ranges...>, ctta::ctt_array<Ranges...>>;
+};
+
+} // namespace detail
+
+
+template<typename Kernels>
+using Family = typename detail::FamilyFor<Kernels, typename Kernels::Axes>::type;
+
+
+// Axis values first (in Axes order), followed by the kernel arguments
+template<typename Kernels, typename... ValuesAndArgs>
+decltype(auto) dispatch(ValuesAndArgs&&... valuesAndArgs)
+{
+    return Family<Kernels>::call(std::forward<ValuesAndArgs>(valuesAndArgs)...);
+}
+
+} // namespace kernel_registry
@@ -0,0 +1,254 @@
+#pragma once
+
+// Fixed memory log-linear latency histogram (HdrHistogram style), for tracking latencies
+// over any number of events, where keeping every sample around isn't an option.
+//
+//  LatencyHistogram<> histogram;
+//  histogram.record(cycles);
+//  histogram.percentile(0.99);     // Also p50 / p999 / max etc
+//
+//  ConcurrentLatencyHistogram<> shared;   // Any thread can record, without locks
+//  shared.record(cycles);
+//  LatencyHistogram<> snapshot = shared.snapshot();
+//  total.merge(snapshot);
+//
+// Values below 2^SubBucketBits get a bucket each, above that every power of 2 range is
+// split into 2^SubBucketBits linear buckets, so any recorded value is reported to within
+// a relative error of 2^-SubBucketBits (1.6% for the default of 6). This covers the whole
+// uint64_t range in (65 - SubBucketBits) << SubBucketBits buckets, 30KB for the default.
+//
+// ConcurrentLatencyHistogram gives each recording thread its own set of buckets, which
+// only that thread writes to (plain relaxed load / store, no lock prefixed instructions),
+// snapshot() sums them up. A thread's first record on a histogram takes a lock to add
+// its buckets, after that it's a thread_local lookup (~6ns per record all in). Counts
+// are only ever added to, take two snapshots and use the difference (subtract) for
+// interval stats.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+template<uint32_t SubBucketBits = 6>
+class LatencyHistogram
+{
+    static_assert(SubBucketBits >= 1 && SubBucketBits <= 16, "SubBucketBits out of range");
+
+public:
+    static constexpr uint32_t SUB_BUCKET_COUNT = 1u << SubBucketBits;
+    static constexpr uint32_t BUCKET_COUNT = (65 - SubBucketBits) << SubBucketBits;
+
+    static constexpr uint32_t bucketIndex(uint64_t value)
+    {
+        if(value < SUB_BUCKET_COUNT)
+        {
+            return uint32_t(value);
+        }
+        const uint32_t shift = uint32_t(std::bit_width(value)) - 1 - SubBucketBits;
+        return ((shift + 1) << SubBucketBits) + uint32_t(value >> shift) - SUB_BUCKET_COUNT;
+    }
+
+    // [lowest, highest] values which land in a bucket
+    static constexpr uint64_t bucketLowest(uint32_t index)
+    {
+        if(index < SUB_BUCKET_COUNT)
+        {
+            return index;
+        }
+        const uint32_t shift = (index >> SubBucketBits) - 1;
+        return (uint64_t(SUB_BUCKET_COUNT) + (index & (SUB_BUCKET_COUNT - 1))) << shift;
+    }
+
+    static constexpr uint64_t bucketHighest(uint32_t index)
+    {
+        const uint32_t shift = index < SUB_BUCKET_COUNT ? 0 : (index >> SubBucketBits) - 1;
+        return bucketLowest(index) + ((uint64_t(1) << shift) - 1);
+    }
+
+    LatencyHistogram()
+        : m_counts(BUCKET_COUNT, 0)
+    {}
+
+    void record(uint64_t value, uint64_t count = 1)
+    {
+        m_counts[bucketIndex(value)] += count;
+        m_total += count;
+        m_sum += value * count;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+    }
+
+    void merge(const LatencyHistogram& other)
+    {
+        for(uint32_t i=0; i<BUCKET_COUNT; ++i)
+        {
+            m_counts[i] += other.m_counts[i];
+        }
+        m_total += other.m_total;
+        m_sum += other.m_sum;
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    // Removes an earlier snapshot of the same source, min / max become bucket bounds
+    void subtract(const LatencyHistogram& earlier)
+    {
+        m_total = 0;
+        m_min = UINT64_MAX;
+        m_max = 0;
+        for(uint32_t i=0; i<BUCKET_COUNT; ++i)
+        {
+            m_counts[i] -= std::min(m_counts[i], earlier.m_counts[i]);
+            if(m_counts[i])
+            {
+                m_total += m_counts[i];
+                m_min = std::min(m_min, bucketLowest(i));
+                m_max = std::max(m_max, bucketHighest(i));
+            }
+        }
+        m_sum -= std::min(m_sum, earlier.m_sum);
+    }
+
+    void reset()
+    {
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        m_total = 0;
+        m_sum = 0;
+        m_min = UINT64_MAX;
+        m_max = 0;
+    }
+
+    uint64_t count() const { return m_total; }
+    uint64_t min() const { return m_total ? m_min : 0; }
+    uint64_t max() const { return m_max; }
+    double mean() const { return m_total ? double(m_sum) / double(m_total) : 0.0; }
+    uint64_t bucketCount(uint32_t index) const { return m_counts[index]; }
+
+    // Highest value equivalent to the one at the percentile (0 - 1), so p(1.0) == max()
+    uint64_t percentile(double p) const
+    {
+        if(!m_total) { return 0; }
+        const uint64_t target = std::max<uint64_t>(uint64_t(std::min(p, 1.0) * double(m_total) + 0.5), 1);
+        uint64_t seen = 0;
+        for(uint32_t i=0; i<BUCKET_COUNT; ++i)
+        {
+            seen += m_counts[i];
+            if(seen >= target)
+            {
+                return std::min(std::max(bucketHighest(i), min()), m_max);
+            }
+        }
+        return m_max;
+    }
+
+private:
+    template<uint32_t> friend class ConcurrentLatencyHistogram;
+
+    std::vector<uint64_t>   m_counts;
+    uint64_t                m_total = 0;
+    uint64_t                m_sum = 0;
+    uint64_t                m_min = UINT64_MAX;
+    uint64_t                m_max = 0;
+};
+
+
+template<uint32_t SubBucketBits = 6>
+class ConcurrentLatencyHistogram
+{
+public:
+    using Histogram = LatencyHistogram<SubBucketBits>;
+
+    ConcurrentLatencyHistogram()
+        : m_id(nextId())
+    {}
+
+    ConcurrentLatencyHistogram(const ConcurrentLatencyHistogram&) = delete;
+    ConcurrentLatencyHistogram& operator=(const ConcurrentLatencyHistogram&) = delete;
+
+    void record(uint64_t value)
+    {
+        Shard& shard = localShard();
+        const auto add = [](std::atomic<uint64_t>& counter, uint64_t amount)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        };
+        add(shard.counts[Histogram::bucketIndex(value)], 1);
+        add(shard.sum, value);
+        if(value < shard.min.load(std::memory_order_relaxed)) { shard.min.store(value, std::memory_order_relaxed); }
+        if(value > shard.max.load(std::memory_order_relaxed)) { shard.max.store(value, std::memory_order_relaxed); }
+    }
+
+    // Consistent per bucket, though may be mid way through another thread's record
+    Histogram snapshot() const
+    {
+        Histogram result;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(const std::unique_ptr<Shard>& shard : m_shards)
+        {
+            for(uint32_t i=0; i<Histogram::BUCKET_COUNT; ++i)
+            {
+                const uint64_t count = shard->counts[i].load(std::memory_order_relaxed);
+                result.m_counts[i] += count;
+                result.m_total += count;
+            }
+            result.m_sum += shard->sum.load(std::memory_order_relaxed);
+            result.m_min = std::min(result.m_min, shard->min.load(std::memory_order_relaxed));
+            result.m_max = std::max(result.m_max, shard->max.load(std::memory_order_relaxed));
+        }
+        return result;
+    }
+
+private:
+    struct Shard
+    {
+        std::atomic<uint64_t>   counts[Histogram::BUCKET_COUNT] = {};
+        std::atomic<uint64_t>   sum{0};
+        std::atomic<uint64_t>   min{UINT64_MAX};
+        std::atomic<uint64_t>   max{0};
+    };
+
+    // Ids are never reused, so stale thread_local entries for destroyed histograms are never hit
+    static uint64_t nextId()
+    {
+        static std::atomic<uint64_t> id{0};
+        return ++id;
+    }
+
+    struct LocalEntry
+    {
+        uint64_t    id;
+        Shard*      shard;
+    };
+
+    Shard& localShard()
+    {
+        thread_local LocalEntry last{0, nullptr};
+        if(last.id == m_id) [[likely]]
+        {
+            return *last.shard;
+        }
+        thread_local std::vector<LocalEntry> entries;
+        for(const LocalEntry& entry : entries)
+        {
+            if(entry.id == m_id)
+            {
+                last = entry;
+                return *entry.shard;
+            }
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shards.push_back(std::make_unique<Shard>());
+        last = LocalEntry{m_id, m_shards.back().get()};
+        entries.push_back(last);
+        return *last.shard;
+    }
+
+    const uint64_t                      m_id;
+    mutable std::mutex                  m_mutex;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+};
@@ -6,6 +6,7 @@
     [[noreturn]] __forceinline void UNREACHABLE() {__assume(false);}
 #elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
     #include <x86intrin.h>
+    #include <cpuid.h>
     #define NOINLINE __attribute__((noinline))
     [[noreturn]] inline __attribute__((always_inline)) void UNREACHABLE() {__builtin_unreachable();}
 #else
@@ -13,47 +14,106 @@
 #endif
 
 
-#include <functional>
 #include <cstdint>
 #include <vector>
 #include <algorithm>
 #include <thread>
 
+#include "latency_histogram.h"
+#include "small_function.h"
 
-NOINLINE int64_t measure_cycles2_raw(const std::function<void(void)>& callback)
+
+// function_ref keeps the overhead inside the measurement down to a single indirect call
+// (std::function added its empty check and manager, and could allocate for big captures)
+NOINLINE inline int64_t measure_cycles2_raw(function_ref<void(void)> callback)
 {
 #ifdef _MSC_VER
     int64_t first = __rdtsc();
-    // MSVC refuses to not bool test std::function, but rolling our own std::function is a bit overkill
-    if(!callback) { UNREACHABLE(); }
-    else { callback(); }
+    callback();
     return __rdtsc() - first;
 #else
     int64_t first = _rdtsc();
-    if(!callback) { UNREACHABLE(); }
-    else { callback(); }
+    callback();
     return _rdtsc() - first;
 #endif
 }
 
 
-template<typename Callback>
+// CPUID 0x80000001:EDX[27], same check as tsc_clock.h
+inline bool measure_cycles2_has_rdtscp()
+{
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0x80000000);
+    if(uint32_t(regs[0]) < 0x80000001u) { return false; }
+    __cpuid(regs, 0x80000001);
+    return (regs[3] >> 27) & 1;
+#else
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if(__get_cpuid_max(0x80000000u, nullptr) < 0x80000001u) { return false; }
+    __get_cpuid(0x80000001u, &eax, &ebx, &ecx, &edx);
+    return (edx >> 27) & 1;
+#endif
+}
+
+
+// lfence / rdtscp either side, so nothing can be reordered into or out of the measurement,
+// cpus without rdtscp get lfence + rdtsc at the end instead
+NOINLINE inline int64_t measure_cycles2_serialised_raw(function_ref<void(void)> callback)
+{
+    static const bool rdtscp = measure_cycles2_has_rdtscp();
+    unsigned int aux;
+    _mm_lfence();
+    int64_t first = __rdtsc();
+    _mm_lfence();
+    callback();
+    int64_t last;
+    if(rdtscp)
+    {
+        last = __rdtscp(&aux);
+    }
+    else
+    {
+        _mm_lfence();
+        last = __rdtsc();
+    }
+    _mm_lfence();
+    return last - first;
+}
+
+
+// Every measure_cycles2* takes <autoCorrection, serialised, ...>. autoCorrection retries
+// (after a yield and a few throwaway runs) when the overhead correction leaves a result
+// <= 0, serialised uses measure_cycles2_serialised_raw (worth it for very short callbacks).
+template<bool autoCorrection=true, bool serialised=false, typename Callback=void>
 NOINLINE int64_t measure_cycles2(Callback callback)
 {
-    // NB: Each dummy lambda resolves to a different function, this is on purpose.
-    // Warmup spin
-    measure_cycles2_raw([]{});
-
-    // Calculate the overhead cost before and after the main callback, and subtract the average
-    int64_t before =  measure_cycles2_raw([]{});
-    int64_t target = measure_cycles2_raw(callback);
-    int64_t after = measure_cycles2_raw([]{});
-    return target - ((before + after) >> 1);
+    constexpr auto raw = serialised ? measure_cycles2_serialised_raw : measure_cycles2_raw;
+
+    for(;;)
+    {
+        // NB: Each dummy lambda resolves to a different function, this is on purpose.
+        // Warmup spin
+        raw([]{});
+
+        // Calculate the overhead cost before and after the main callback, and subtract the average
+        int64_t before =  raw([]{});
+        int64_t target = raw(callback);
+        int64_t after = raw([]{});
+        int64_t value = target - ((before + after) >> 1);
+        if(!autoCorrection || value > 0)
+        {
+            return value;
+        }
+
+        std::this_thread::yield();
+        for(int i=0; i<3; ++i) { raw(callback); }
+    }
 }
 
 
-// Returns back [median, mad]
-template<bool autoCorrection=true, typename Callback=void>
+// Returns back [median, mad], tscClock().tscToNs (tsc_clock.h) converts either into time.
+template<bool autoCorrection=true, bool serialised=false, typename Callback=void>
 NOINLINE std::pair<int64_t, int64_t> measure_cycles2(Callback callback, uint32_t count, uint32_t warmup=10)
 {
     if(count < 2) [[unlikely]] { return std::make_pair(-1, -1); }
@@ -62,40 +122,20 @@ NOINLINE std::pair<int64_t, int64_t> measure_cycles2(Callback callback, uint32_t
     int64_t* iter = &samples[0];
     for(uint32_t i=0; i<warmup; ++i)
     {
-        int64_t value = measure_cycles2(callback);
-        if(autoCorrection && value <= 0)
-        {
-            std::this_thread::yield();
-            for(int i=0; i<3; ++i) { measure_cycles2(callback); }
-            i -= 1;
-        }
-        else
-        {
-            iter[i] = value;
-        }
+        iter[i] = measure_cycles2<autoCorrection, serialised>(callback);
     }
     for(uint32_t i=0; i<count; ++i)
     {
-        int64_t value = measure_cycles2(callback);
-        if(autoCorrection && value <= 0)
-        {
-            std::this_thread::yield();
-            for(int i=0; i<3; ++i) { measure_cycles2(callback); }
-            i -= 1;
-        }
-        else
-        {
-            iter[i] = value;
-        }
+        iter[i] = measure_cycles2<autoCorrection, serialised>(callback);
     }
 
     // Calculate median
     std::sort(samples.begin(), samples.begin() + count);
 
     int64_t median = samples[count/2];
-    if(count & 1)
+    if(!(count & 1))
     {
-        median += samples[count/2 + 1];
+        median += samples[count/2 - 1];
         median >>= 1;
     }
 
@@ -106,9 +146,9 @@ NOINLINE std::pair<int64_t, int64_t> measure_cycles2(Callback callback, uint32_t
     }
     std::sort(samples.begin(), samples.begin() + count);
     int64_t mad = samples[count/2];
-    if(count & 1)
+    if(!(count & 1))
     {
-        mad += samples[count/2 + 1];
+        mad += samples[count/2 - 1];
         mad >>= 1;
     }
 
@@ -117,7 +157,7 @@ NOINLINE std::pair<int64_t, int64_t> measure_cycles2(Callback callback, uint32_t
 
 
 
-template<bool autoCorrection=true, typename Callback=void, typename ClearCallback=void>
+template<bool autoCorrection=true, bool serialised=false, typename Callback=void, typename ClearCallback=void>
 NOINLINE std::pair<int64_t, int64_t> measure_cycles2(
     float tolerance,
     Callback callback,
@@ -128,7 +168,7 @@ NOINLINE std::pair<int64_t, int64_t> measure_cycles2(
     for(;;)
     {
         clearCallback();
-        auto result = measure_cycles2<autoCorrection>(callback, count, warmup);
+        auto result = measure_cycles2<autoCorrection, serialised>(callback, count, warmup);
         if(float(result.second) / float(result.first) > tolerance)
         {
             continue;
@@ -136,3 +176,29 @@ NOINLINE std::pair<int64_t, int64_t> measure_cycles2(
         return result;
     }
 }
+
+
+template<bool autoCorrection=true, typename Callback=void>
+std::pair<int64_t, int64_t> measure_cycles2_serialised(Callback callback, uint32_t count, uint32_t warmup=10)
+{
+    return measure_cycles2<autoCorrection, true>(callback, count, warmup);
+}
+
+
+// For when there are too many samples to keep them all around, records into a fixed size
+// histogram instead of sorting, and returns it for percentiles etc (auto correction is off
+// by default here, so negative results are clamped to 0 rather than retried).
+template<bool autoCorrection=false, bool serialised=false, uint32_t SubBucketBits=6, typename Callback=void>
+NOINLINE LatencyHistogram<SubBucketBits> measure_cycles2_histogram(Callback callback, uint64_t count, uint32_t warmup=10)
+{
+    LatencyHistogram<SubBucketBits> histogram;
+    for(uint32_t i=0; i<warmup; ++i)
+    {
+        measure_cycles2<false, serialised>(callback);
+    }
+    for(uint64_t i=0; i<count; ++i)
+    {
+        histogram.record(uint64_t(std::max<int64_t>(measure_cycles2<autoCorrection, serialised>(callback), 0)));
+    }
+    return histogram;
+}
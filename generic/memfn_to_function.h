@@ -1,15 +1,17 @@
 #pragma once
 
 
-#include <functional>
+#include "small_function.h"
 
 
+// The object + member function pointer capture fits small_function's default capacity,
+// so this never allocates (unlike the std::function it used to return).
 template<typename Class, typename Ret, typename... Args>
-std::function<Ret(Args...)> memfn_to_function(
+small_function<Ret(Args...)> memfn_to_function(
     Class* self,
     Ret (Class::*meth)(Args...)
 ) {
-    return [self, meth](Args&&... args) -> Ret
+    return [self, meth](Args... args) -> Ret
     {
         return (self->* meth)(std::forward<Args>(args)...);
     };
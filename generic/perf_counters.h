@@ -0,0 +1,320 @@
+#pragma once
+
+// Hardware performance counters via perf_event_open (linux only), measured around the
+// same sort of callback measure_cycles2 takes.
+//
+// rdtsc counts reference cycles, which are skewed by frequency scaling and don't say
+// anything about why something is slow, these are the real core cycles, instructions,
+// branch misses and L1D / LLC / dTLB read misses (userspace only).
+//
+//  PerfCountersResult r = measure_counters2([&]{ work(); }, 101);
+//  printPerfCounters(stdout, r);
+//
+//  cycles              12034 +/- 41
+//  instructions        40112 +/- 3       ipc 3.33
+//  branch-misses       12 +/- 1
+//  ...
+//
+// When the counters can't be opened (no PMU exposed in VMs / containers, or
+// perf_event_paranoid being too strict), it falls back to rdtsc via measure_cycles2, with
+// only the cycles filled in (as reference cycles) and usingRdtsc set.
+//
+// Counters are opened as a single group, so they're always scheduled together. A group
+// that doesn't fit on the PMU is never scheduled at all, which counts as unavailable (so
+// rdtsc again). When the group is time sliced with other perf users, PerfCounters::stop
+// scales every value by time_enabled / time_running, which makes those samples estimates
+// of the full run rather than exact counts.
+//
+
+#include "measure_cycles_2.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+
+enum class PerfCounter : uint32_t
+{
+    Cycles,
+    Instructions,
+    BranchMisses,
+    L1DMisses,
+    LLCMisses,
+    DTLBMisses,
+
+    Count
+};
+
+
+inline const char* perfCounterName(const PerfCounter counter)
+{
+    switch(counter)
+    {
+        case PerfCounter::Cycles:       return "cycles";
+        case PerfCounter::Instructions: return "instructions";
+        case PerfCounter::BranchMisses: return "branch-misses";
+        case PerfCounter::L1DMisses:    return "l1d-misses";
+        case PerfCounter::LLCMisses:    return "llc-misses";
+        case PerfCounter::DTLBMisses:   return "dtlb-misses";
+        default:                        return "unknown";
+    }
+}
+
+
+constexpr size_t PERF_COUNTER_COUNT = size_t(PerfCounter::Count);
+
+
+class PerfCounters
+{
+public:
+    PerfCounters()
+    {
+        std::fill(m_fds, m_fds + PERF_COUNTER_COUNT, -1);
+#if defined(__linux__)
+        for(size_t i=0; i<PERF_COUNTER_COUNT; ++i)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            eventConfig(PerfCounter(i), attr.type, attr.config);
+            attr.disabled = m_leader < 0 ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            const int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, m_leader, 0));
+            if(fd < 0)
+            {
+                continue;
+            }
+            if(m_leader < 0)
+            {
+                m_leader = fd;
+            }
+            m_fds[i] = fd;
+            m_order[m_opened++] = uint32_t(i);
+        }
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#if defined(__linux__)
+        for(int fd : m_fds)
+        {
+            if(fd >= 0) { close(fd); }
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const { return m_opened > 0; }
+    bool has(const PerfCounter counter) const { return m_fds[size_t(counter)] >= 0; }
+
+    void start()
+    {
+#if defined(__linux__)
+        ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    // Values for counters which aren't available are left as 0, returns false if the
+    // counters didn't get scheduled at all.
+    bool stop(double* values)
+    {
+        std::fill(values, values + PERF_COUNTER_COUNT, 0.0);
+#if defined(__linux__)
+        ioctl(m_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        // nr, time_enabled, time_running, values[nr]
+        uint64_t buffer[3 + PERF_COUNTER_COUNT];
+        const ssize_t expected = ssize_t(sizeof(uint64_t) * (3 + m_opened));
+        if(read(m_leader, buffer, sizeof(buffer)) < expected || buffer[2] == 0)
+        {
+            return false;
+        }
+        // Multiplexed, the group only counted for time_running of time_enabled, so the counts
+        // are extrapolated to the whole interval (1 when it was scheduled throughout)
+        const double scale = double(buffer[1]) / double(buffer[2]);
+        for(uint32_t i=0; i<m_opened; ++i)
+        {
+            values[m_order[i]] = double(buffer[3 + i]) * scale;
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+private:
+#if defined(__linux__)
+    static void eventConfig(const PerfCounter counter, __u32& type, __u64& config)
+    {
+        const auto cache = [](__u64 cacheId) -> __u64
+        {
+            return cacheId | (__u64(PERF_COUNT_HW_CACHE_OP_READ) << 8) | (__u64(PERF_COUNT_HW_CACHE_RESULT_MISS) << 16);
+        };
+        type = PERF_TYPE_HARDWARE;
+        switch(counter)
+        {
+            case PerfCounter::Cycles:       config = PERF_COUNT_HW_CPU_CYCLES; break;
+            case PerfCounter::Instructions: config = PERF_COUNT_HW_INSTRUCTIONS; break;
+            case PerfCounter::BranchMisses: config = PERF_COUNT_HW_BRANCH_MISSES; break;
+            case PerfCounter::L1DMisses:    type = PERF_TYPE_HW_CACHE; config = cache(PERF_COUNT_HW_CACHE_L1D); break;
+            case PerfCounter::LLCMisses:    type = PERF_TYPE_HW_CACHE; config = cache(PERF_COUNT_HW_CACHE_LL); break;
+            case PerfCounter::DTLBMisses:   type = PERF_TYPE_HW_CACHE; config = cache(PERF_COUNT_HW_CACHE_DTLB); break;
+            default:                        config = 0; break;
+        }
+    }
+#endif
+
+    int         m_fds[PERF_COUNTER_COUNT];
+    uint32_t    m_order[PERF_COUNTER_COUNT] = {};   // Group read order => counter
+    uint32_t    m_opened = 0;
+    int         m_leader = -1;
+};
+
+
+struct PerfCounterStats
+{
+    double  median = 0.0;
+    double  mad = 0.0;
+    bool    available = false;
+};
+
+
+struct PerfCountersResult
+{
+    PerfCounterStats    counters[PERF_COUNTER_COUNT];
+    double              ipc = 0.0;          // Median of per sample instructions / cycles, 0 if unavailable
+    bool                usingRdtsc = false; // Only cycles available, as reference cycles from rdtsc
+
+    const PerfCounterStats& operator[](const PerfCounter counter) const { return counters[size_t(counter)]; }
+};
+
+
+namespace detail
+{
+
+inline std::pair<double, double> perfMedianMad(std::vector<double>& values)
+{
+    if(values.empty()) { return std::make_pair(0.0, 0.0); }
+    const auto median = [](std::vector<double>& v)
+    {
+        std::sort(v.begin(), v.end());
+        const size_t n = v.size();
+        return (n & 1) ? v[n/2] : 0.5 * (v[n/2 - 1] + v[n/2]);
+    };
+    const double m = median(values);
+    for(double& v : values) { v = std::abs(v - m); }
+    return std::make_pair(m, median(values));
+}
+
+} // namespace detail
+
+
+// Callback is run (warmup + count) times, each sample has the overhead of an empty
+// callback (averaged from either side of it) subtracted, same as measure_cycles2.
+template<typename Callback>
+NOINLINE PerfCountersResult measure_counters2(Callback callback, uint32_t count, uint32_t warmup=10)
+{
+    PerfCountersResult result;
+    if(count < 2) [[unlikely]] { return result; }
+
+    PerfCounters counters;
+    std::vector<double> samples[PERF_COUNTER_COUNT];
+    std::vector<double> ipcs;
+
+    bool usable = counters.available();
+    if(usable)
+    {
+        double before[PERF_COUNTER_COUNT];
+        double target[PERF_COUNTER_COUNT];
+        double after[PERF_COUNTER_COUNT];
+        const auto sample = [&](auto&& fn, double* values)
+        {
+            counters.start();
+            fn();
+            return counters.stop(values);
+        };
+
+        for(uint32_t i=0; i<warmup + count && usable; ++i)
+        {
+            // NB: Each dummy lambda resolves to a different function, this is on purpose.
+            usable = sample([]{}, before) && sample(callback, target) && sample([]{}, after);
+            if(!usable || i < warmup)
+            {
+                continue;
+            }
+            double adjusted[PERF_COUNTER_COUNT];
+            for(size_t c=0; c<PERF_COUNTER_COUNT; ++c)
+            {
+                adjusted[c] = std::max(target[c] - 0.5 * (before[c] + after[c]), 0.0);
+                samples[c].push_back(adjusted[c]);
+            }
+            const double cycles = adjusted[size_t(PerfCounter::Cycles)];
+            if(counters.has(PerfCounter::Cycles) && counters.has(PerfCounter::Instructions) && cycles > 0.0)
+            {
+                ipcs.push_back(adjusted[size_t(PerfCounter::Instructions)] / cycles);
+            }
+        }
+    }
+
+    if(usable)
+    {
+        for(size_t c=0; c<PERF_COUNTER_COUNT; ++c)
+        {
+            const auto stats = detail::perfMedianMad(samples[c]);
+            result.counters[c].median = stats.first;
+            result.counters[c].mad = stats.second;
+            result.counters[c].available = counters.has(PerfCounter(c));
+        }
+        result.ipc = ipcs.empty() ? 0.0 : detail::perfMedianMad(ipcs).first;
+        return result;
+    }
+
+    // Fallback to reference cycles
+    const auto cycles = measure_cycles2(callback, count, warmup);
+    PerfCounterStats& stats = result.counters[size_t(PerfCounter::Cycles)];
+    stats.median = double(cycles.first);
+    stats.mad = double(cycles.second);
+    stats.available = true;
+    result.usingRdtsc = true;
+    return result;
+}
+
+
+inline void printPerfCounters(FILE* out, const PerfCountersResult& result)
+{
+    for(size_t c=0; c<PERF_COUNTER_COUNT; ++c)
+    {
+        const PerfCounterStats& stats = result.counters[c];
+        if(!stats.available)
+        {
+            continue;
+        }
+        std::fprintf(out, "%-20s%.0f +/- %.0f", perfCounterName(PerfCounter(c)), stats.median, stats.mad);
+        if(PerfCounter(c) == PerfCounter::Cycles && result.usingRdtsc)
+        {
+            std::fprintf(out, "    (rdtsc, perf counters unavailable)");
+        }
+        if(PerfCounter(c) == PerfCounter::Instructions && result.ipc > 0.0)
+        {
+            std::fprintf(out, "    ipc %.2f", result.ipc);
+        }
+        std::fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,522 @@
+#pragma once
+
+// Always-on scoped profiling zones, cheap enough to leave in hot paths.
+//
+//  void update()
+//  {
+//      PROFILE_ZONE("update");
+//      ...
+//      {
+//          PROFILE_ZONE("update/physics");
+//          ...
+//      }
+//  }
+//
+//  profile::collector().startBackground(std::chrono::milliseconds(50));
+//  ...
+//  for(const profile::ZoneStats& zone : profile::collector().stats()) { ... zone.percentile(0.99) ... }
+//  std::ofstream file("trace.json");
+//  profile::collector().writeChromeTrace(file);  // chrome://tracing or ui.perfetto.dev
+//
+// A zone is two rdtsc's and a 24 byte write into the calling thread's ring buffer, the
+// name is hashed at compile time (wyhash), and registered once per call site during static
+// initialisation, so there's no string handling (or init guard) at runtime. The cost is almost entirely the rdtsc's, measured at
+// ~3ns per zone on top of them (which themselves vary from ~6ns for the pair on bare
+// metal, to ~50ns in VMs that trap rdtsc).
+//
+// Rings are single producer (the owning thread) / single consumer (collect), and never
+// block the producer, if the collector falls behind the oldest events are overwritten
+// and counted in dropped(). collect() aggregates them into per zone log2 histograms, and
+// keeps the most recent traceCapacity events around for writeChromeTrace.
+//
+// Define PROFILE_ZONES_ENABLED to 0 to compile the zones out entirely, the collector is
+// still there (just with nothing to collect) so any reporting code still builds.
+//
+
+#ifndef PROFILE_ZONES_ENABLED
+    #define PROFILE_ZONES_ENABLED 1
+#endif
+
+// Events per thread, must be a power of 2
+#ifndef PROFILE_ZONES_RING_CAPACITY
+    #define PROFILE_ZONES_RING_CAPACITY (1u << 14)
+#endif
+
+
+#include "wyhash.h"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+    #include <intrin.h>
+    #define PROFILE_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <x86intrin.h>
+    #define PROFILE_NOINLINE __attribute__((noinline))
+#else
+    #error "Only really intended for x64 gcc/clang/msc"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+namespace profile
+{
+
+struct Event
+{
+    uint64_t    id;
+    uint64_t    start;
+    uint64_t    end;
+};
+
+
+namespace detail
+{
+
+static_assert((PROFILE_ZONES_RING_CAPACITY & (PROFILE_ZONES_RING_CAPACITY - 1)) == 0, "Ring capacity must be a power of 2");
+constexpr uint64_t RING_CAPACITY = PROFILE_ZONES_RING_CAPACITY;
+constexpr uint64_t RING_MASK = RING_CAPACITY - 1;
+
+struct ThreadRing
+{
+    alignas(64) std::atomic<uint64_t>   head{0};        // Written by the owning thread only
+    alignas(64) std::atomic<uint64_t>   tail{0};        // Written by the collector only
+    std::atomic<bool>                   retired{false}; // Owning thread exited
+    uint32_t                            threadIndex = 0;    // Kept when a ring is reused
+    Event                               events[RING_CAPACITY];
+};
+
+struct Site
+{
+    std::string     name;
+    const char*     file;
+    uint32_t        line;
+};
+
+struct Registry
+{
+    std::mutex                                  mutex;
+    std::vector<std::unique_ptr<ThreadRing>>    rings;
+    std::unordered_map<uint64_t, Site>          sites;
+    uint32_t                                    nextThreadIndex = 0;
+};
+
+inline Registry& registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+inline thread_local ThreadRing* t_ring = nullptr;
+
+// Only touched on the slow path, so t_ring itself stays a plain (no init guard) thread_local
+struct RingRelease
+{
+    ~RingRelease()
+    {
+        if(t_ring) { t_ring->retired.store(true, std::memory_order_release); }
+    }
+};
+
+PROFILE_NOINLINE inline ThreadRing* acquireRing()
+{
+    static thread_local RingRelease release;
+    (void)release;
+
+    Registry& instance = registry();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+
+    // Reuse the ring of an exited thread once it has been fully drained
+    for(const std::unique_ptr<ThreadRing>& ring : instance.rings)
+    {
+        if(ring->retired.load(std::memory_order_acquire) && ring->head.load(std::memory_order_relaxed) == ring->tail.load(std::memory_order_acquire))
+        {
+            ring->retired.store(false, std::memory_order_relaxed);
+            t_ring = ring.get();
+            return t_ring;
+        }
+    }
+    instance.rings.push_back(std::make_unique<ThreadRing>());
+    instance.rings.back()->threadIndex = instance.nextThreadIndex++;
+    t_ring = instance.rings.back().get();
+    return t_ring;
+}
+
+} // namespace detail
+
+
+inline uint64_t now()
+{
+#ifdef _MSC_VER
+    return __rdtsc();
+#else
+    return _rdtsc();
+#endif
+}
+
+
+// Called once per call site, the first registration of a name wins
+inline bool registerZone(uint64_t id, const char* name, const char* file, uint32_t line)
+{
+    detail::Registry& registry = detail::registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.sites.emplace(id, detail::Site{name, file, line});
+    return true;
+}
+
+
+namespace detail
+{
+
+// One per PROFILE_ZONE (Site is a local struct), initialised at startup, the zone only takes
+// its address so nothing is checked each time it runs
+template<typename Site>
+inline const bool siteRegistered = Site::registerSite();
+
+} // namespace detail
+
+
+inline void record(uint64_t id, uint64_t start, uint64_t end)
+{
+    detail::ThreadRing* ring = detail::t_ring;
+    if(!ring) [[unlikely]]
+    {
+        ring = detail::acquireRing();
+    }
+    const uint64_t head = ring->head.load(std::memory_order_relaxed);
+    ring->events[head & detail::RING_MASK] = Event{id, start, end};
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+
+class Zone
+{
+public:
+    explicit Zone(uint64_t id)
+        : m_id(id)
+        , m_start(now())
+    {}
+
+    ~Zone()
+    {
+        record(m_id, m_start, now());
+    }
+
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+
+private:
+    uint64_t    m_id;
+    uint64_t    m_start;
+};
+
+
+struct ZoneStats
+{
+    uint64_t        id = 0;
+    std::string     name;
+    const char*     file = nullptr;
+    uint32_t        line = 0;
+    uint64_t        count = 0;
+    uint64_t        totalCycles = 0;
+    uint64_t        minCycles = UINT64_MAX;
+    uint64_t        maxCycles = 0;
+    uint64_t        buckets[64] = {};       // [i] counts durations in [2^(i-1), 2^i), [0] is 0 cycles
+
+    void add(uint64_t cycles)
+    {
+        ++count;
+        totalCycles += cycles;
+        minCycles = std::min(minCycles, cycles);
+        maxCycles = std::max(maxCycles, cycles);
+        ++buckets[std::min(int(std::bit_width(cycles)), 63)];
+    }
+
+    double meanCycles() const { return count ? double(totalCycles) / double(count) : 0.0; }
+
+    // Upper bound of the bucket containing the percentile (0 - 1), clamped to [min, max]
+    uint64_t percentile(double p) const
+    {
+        if(!count) { return 0; }
+        const uint64_t target = std::max<uint64_t>(uint64_t(p * double(count) + 0.5), 1);
+        uint64_t seen = 0;
+        for(uint32_t i=0; i<64; ++i)
+        {
+            seen += buckets[i];
+            if(seen >= target)
+            {
+                const uint64_t upper = i ? (uint64_t(1) << i) - 1 : 0;
+                return std::min(std::max(upper, minCycles), maxCycles);
+            }
+        }
+        return maxCycles;
+    }
+};
+
+
+class Collector
+{
+public:
+    explicit Collector(size_t traceCapacity = size_t(1) << 20)
+        : m_trace(traceCapacity)
+        , m_baseTsc(now())
+        , m_baseTime(std::chrono::steady_clock::now())
+    {}
+
+    ~Collector()
+    {
+        stopBackground();
+    }
+
+    Collector(const Collector&) = delete;
+    Collector& operator=(const Collector&) = delete;
+
+    // Drains every thread's ring into the stats and trace buffer
+    void collect()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<detail::ThreadRing*> rings;
+        {
+            detail::Registry& registry = detail::registry();
+            std::lock_guard<std::mutex> registryLock(registry.mutex);
+            for(const auto& ring : registry.rings) { rings.push_back(ring.get()); }
+        }
+        for(detail::ThreadRing* ring : rings)
+        {
+            drain(*ring);
+        }
+    }
+
+    void startBackground(std::chrono::milliseconds period)
+    {
+        stopBackground();
+        m_stop = false;
+        m_thread = std::thread([this, period]
+        {
+            std::unique_lock<std::mutex> lock(m_threadMutex);
+            while(!m_wake.wait_for(lock, period, [this]{ return m_stop; }))
+            {
+                collect();
+            }
+        });
+    }
+
+    void stopBackground()
+    {
+        if(!m_thread.joinable()) { return; }
+        {
+            std::lock_guard<std::mutex> lock(m_threadMutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+    }
+
+    // Sorted by total time, descending
+    std::vector<ZoneStats> stats()
+    {
+        collect();
+        std::vector<ZoneStats> result;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for(const auto& entry : m_stats) { result.push_back(entry.second); }
+        }
+        detail::Registry& registry = detail::registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for(ZoneStats& zone : result)
+        {
+            const auto site = registry.sites.find(zone.id);
+            if(site != registry.sites.end())
+            {
+                zone.name = site->second.name;
+                zone.file = site->second.file;
+                zone.line = site->second.line;
+            }
+        }
+        std::sort(result.begin(), result.end(), [](const ZoneStats& a, const ZoneStats& b){ return a.totalCycles > b.totalCycles; });
+        return result;
+    }
+
+    // Events lost to rings wrapping before they were collected
+    uint64_t dropped()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_dropped;
+    }
+
+    void reset()
+    {
+        collect();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.clear();
+        m_traceCount = 0;
+        m_dropped = 0;
+    }
+
+    // Chrome trace event format, complete ("X") events with microsecond timestamps
+    void writeChromeTrace(std::ostream& out)
+    {
+        collect();
+        const double ticksPerUs = this->ticksPerUs();
+
+        std::unordered_map<uint64_t, std::string> names;
+        {
+            detail::Registry& registry = detail::registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            for(const auto& site : registry.sites) { names.emplace(site.first, escapeJson(site.second.name)); }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+        const size_t capacity = m_trace.size();
+        const size_t count = std::min<size_t>(m_traceCount, capacity);
+        // Zones recorded before the collector existed start before m_baseTsc, so the trace
+        // starts at whichever's earliest rather than going negative
+        uint64_t epoch = m_baseTsc;
+        for(size_t i=0; i<count; ++i)
+        {
+            epoch = std::min(epoch, m_trace[(m_traceCount - count + i) % capacity].event.start);
+        }
+        char buffer[128];
+        for(size_t i=0; i<count; ++i)
+        {
+            const TraceEvent& event = m_trace[(m_traceCount - count + i) % capacity];
+            const auto name = names.find(event.event.id);
+            const double ts = double(event.event.start - epoch) / ticksPerUs;
+            const double dur = double(event.event.end - event.event.start) / ticksPerUs;
+            std::snprintf(buffer, sizeof(buffer), "\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %u}", ts, dur, event.threadIndex);
+            out << "  {\"name\": \"" << (name != names.end() ? name->second : std::string("?")) << buffer << (i + 1 < count ? ",\n" : "\n");
+        }
+        out << "]}\n";
+    }
+
+private:
+    struct TraceEvent
+    {
+        Event       event;
+        uint32_t    threadIndex;
+    };
+
+    void drain(detail::ThreadRing& ring)
+    {
+        const uint64_t head = ring.head.load(std::memory_order_acquire);
+        uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        if(head - tail > detail::RING_CAPACITY)
+        {
+            m_dropped += head - tail - detail::RING_CAPACITY;
+            tail = head - detail::RING_CAPACITY;
+        }
+        m_scratch.resize(size_t(head - tail));
+        for(uint64_t i=tail; i<head; ++i)
+        {
+            std::memcpy(&m_scratch[size_t(i - tail)], &ring.events[i & detail::RING_MASK], sizeof(Event));
+        }
+
+        // Anything the producer lapped while we were copying may be torn, same idea as a seqlock
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t headAfter = ring.head.load(std::memory_order_relaxed);
+        const uint64_t safeFrom = headAfter > detail::RING_CAPACITY ? headAfter - detail::RING_CAPACITY : 0;
+        size_t first = 0;
+        if(safeFrom > tail)
+        {
+            first = size_t(std::min(safeFrom, head) - tail);
+            m_dropped += first;
+        }
+        ring.tail.store(head, std::memory_order_release);
+
+        for(size_t i=first; i<m_scratch.size(); ++i)
+        {
+            const Event& event = m_scratch[i];
+            // Threads migrating between cores with unsynchronised TSCs can go backwards
+            const uint64_t cycles = event.end > event.start ? event.end - event.start : 0;
+            ZoneStats& zone = m_stats[event.id];
+            zone.id = event.id;
+            zone.add(cycles);
+            if(!m_trace.empty())
+            {
+                m_trace[m_traceCount % m_trace.size()] = TraceEvent{event, ring.threadIndex};
+                ++m_traceCount;
+            }
+        }
+    }
+
+    double ticksPerUs()
+    {
+        auto elapsed = std::chrono::steady_clock::now() - m_baseTime;
+        if(elapsed < std::chrono::milliseconds(10))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10) - elapsed);
+        }
+        const uint64_t tsc = now();
+        elapsed = std::chrono::steady_clock::now() - m_baseTime;
+        return double(tsc - m_baseTsc) / std::chrono::duration<double, std::micro>(elapsed).count();
+    }
+
+    static std::string escapeJson(const std::string& value)
+    {
+        std::string result;
+        for(char c : value)
+        {
+            if(c == '"' || c == '\\') { result += '\\'; result += c; }
+            else if(uint8_t(c) < 0x20) { result += ' '; }
+            else { result += c; }
+        }
+        return result;
+    }
+
+    std::mutex                                  m_mutex;
+    std::unordered_map<uint64_t, ZoneStats>     m_stats;
+    std::vector<TraceEvent>                     m_trace;
+    uint64_t                                    m_traceCount = 0;
+    uint64_t                                    m_dropped = 0;
+    std::vector<Event>                          m_scratch;
+    uint64_t                                    m_baseTsc;
+    std::chrono::steady_clock::time_point       m_baseTime;
+
+    std::thread                                 m_thread;
+    std::mutex                                  m_threadMutex;
+    std::condition_variable                     m_wake;
+    bool                                        m_stop = false;
+};
+
+
+inline Collector& collector()
+{
+    static Collector instance;
+    return instance;
+}
+
+} // namespace profile
+
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+#if PROFILE_ZONES_ENABLED
+    #define PROFILE_ZONE(name)                                                                                          \
+        static constexpr uint64_t PROFILE_CONCAT(profileZoneId_, __LINE__) = ::wyhash::wyhash(std::string_view(name));  \
+        struct PROFILE_CONCAT(ProfileZoneSite_, __LINE__)                                                               \
+        {                                                                                                               \
+            static bool registerSite()                                                                                  \
+            {                                                                                                           \
+                return ::profile::registerZone(PROFILE_CONCAT(profileZoneId_, __LINE__), name, __FILE__, __LINE__);     \
+            }                                                                                                           \
+        };                                                                                                              \
+        (void)&::profile::detail::siteRegistered<PROFILE_CONCAT(ProfileZoneSite_, __LINE__)>;                           \
+        ::profile::Zone PROFILE_CONCAT(profileZone_, __LINE__)(PROFILE_CONCAT(profileZoneId_, __LINE__))
+#else
+    #define PROFILE_ZONE(name) do {} while(0)
+#endif
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "small_function.h"
+
+
+// LSD radix sort for unsigned integer keys (Morton codes, hashes, offsets), 8 bits per pass,
+// optionally carrying a value along with each key. It's stable, so equal keys keep their
+// values in the original order.
+//
+// radix_sort(keys, count);
+// radix_sort_pairs(keys, values, count);
+//
+// Passes where every key has the same digit (e.g the top byte of 30 bit Morton codes) are
+// skipped. It needs a scratch copy of the keys (and values), allocated internally.
+//
+// Passing a parallel_for_ref (small_function.h) splits each pass into tasks, each with its
+// own histogram (and so its own range of every bucket to scatter into). Tasks get at least
+// 64K keys each, and default to hardware_concurrency() of them.
+//
+// Random keys, 1 thread (GCC 12, -O2), millions of keys per second:
+//
+//                              1M          10M         100M
+//    std::sort  uint32_t       ~8          ~7          ~6
+//    radix_sort uint32_t       ~26         ~25         ~22
+//    std::sort  uint64_t       ~8          ~7
+//    radix_sort uint64_t       ~9          ~9
+//    std::stable_sort pairs    ~6          ~5                      (uint32_t keys + values)
+//    radix_sort_pairs          ~15         ~17         ~14
+//
+// Each pass is bound by the scatter, ~8ns per key into 256 buckets, 64 bit keys only win
+// when some of their passes get skipped.
+//
+// See sse/bitonic_sort.h for uint32_t keys without values.
+//
+
+
+namespace detail::radix_sort {
+
+constexpr size_t RADIX = 256;
+constexpr size_t MIN_KEYS_PER_TASK = 64 * 1024;
+
+using histogram = std::array<size_t, RADIX>;
+
+struct no_value {};
+
+
+template<typename Key, typename Value>
+void sort(Key* keys, Value* values, const size_t count, size_t tasks, const parallel_for_ref* parallel) {
+
+    static_assert(std::is_unsigned_v<Key>, "radix_sort needs unsigned integer keys");
+    static_assert(std::is_trivially_copyable_v<Value>, "radix_sort moves values with memcpy");
+
+    constexpr bool has_values = !std::is_same_v<Value, no_value>;
+    constexpr size_t passes = sizeof(Key);
+
+    if(count < 2) {
+        return;
+    }
+
+    tasks = std::clamp<size_t>(count / MIN_KEYS_PER_TASK, 1, std::max<size_t>(tasks, 1));
+    const size_t per_task = (count + tasks - 1) / tasks;
+
+    auto run = [&](function_ref<void(size_t)> task) {
+        if(tasks == 1 || parallel == nullptr) {
+            for(size_t i = 0; i < tasks; ++i) {
+                task(i);
+            }
+        } else {
+            (*parallel)(tasks, task);
+        }
+    };
+
+    std::unique_ptr<Key[]> key_scratch(new Key[count]);
+    std::unique_ptr<Value[]> value_scratch(has_values ? new Value[count] : nullptr);
+
+    Key* src_keys = keys;
+    Key* dst_keys = key_scratch.get();
+    Value* src_values = values;
+    Value* dst_values = value_scratch.get();
+
+    std::vector<histogram> counts(tasks);
+    std::vector<histogram> offsets(tasks);
+
+    // Single task, every pass's histogram comes out of one read of the keys
+    std::vector<histogram> all_passes;
+    if(tasks == 1) {
+        all_passes.assign(passes, histogram{});
+        for(size_t i = 0; i < count; ++i) {
+            const Key key = keys[i];
+            for(size_t pass = 0; pass < passes; ++pass) {
+                ++all_passes[pass][(key >> (pass * 8)) & 0xff];
+            }
+        }
+    }
+
+    for(size_t pass = 0; pass < passes; ++pass) {
+
+        const size_t shift = pass * 8;
+
+        if(tasks == 1) {
+            counts[0] = all_passes[pass];
+        } else {
+            run([&](size_t task) {
+                histogram& h = counts[task];
+                h.fill(0);
+                const size_t end = std::min(count, (task + 1) * per_task);
+                for(size_t i = task * per_task; i < end; ++i) {
+                    ++h[(src_keys[i] >> shift) & 0xff];
+                }
+            });
+        }
+
+        // Every key in one bucket, nothing would move
+        const size_t first_digit = (src_keys[0] >> shift) & 0xff;
+        size_t first_digit_count = 0;
+        for(const histogram& h : counts) {
+            first_digit_count += h[first_digit];
+        }
+        if(first_digit_count == count) {
+            continue;
+        }
+
+        // Each task scatters into its own slice of each bucket, after the slices of earlier tasks
+        size_t offset = 0;
+        for(size_t digit = 0; digit < RADIX; ++digit) {
+            for(size_t task = 0; task < tasks; ++task) {
+                offsets[task][digit] = offset;
+                offset += counts[task][digit];
+            }
+        }
+
+        run([&](size_t task) {
+            // Locals, so the compiler knows the stores to dst can't be touching them
+            histogram next = offsets[task];
+            const Key* const from_keys = src_keys;
+            const Value* const from_values = src_values;
+            Key* const to_keys = dst_keys;
+            Value* const to_values = dst_values;
+            const size_t digit_shift = shift;
+
+            const size_t end = std::min(count, (task + 1) * per_task);
+            for(size_t i = task * per_task; i < end; ++i) {
+                const Key key = from_keys[i];
+                const size_t to = next[(key >> digit_shift) & 0xff]++;
+                to_keys[to] = key;
+                if constexpr(has_values) {
+                    to_values[to] = from_values[i];
+                }
+            }
+        });
+
+        std::swap(src_keys, dst_keys);
+        std::swap(src_values, dst_values);
+    }
+
+    // An odd number of passes ran, the result is in the scratch
+    if(src_keys != keys) {
+        run([&](size_t task) {
+            const size_t begin = std::min(count, task * per_task);
+            const size_t end = std::min(count, (task + 1) * per_task);
+            std::memcpy(keys + begin, src_keys + begin, (end - begin) * sizeof(Key));
+            if constexpr(has_values) {
+                std::memcpy(values + begin, src_values + begin, (end - begin) * sizeof(Value));
+            }
+        });
+    }
+}
+
+} // namespace detail::radix_sort
+
+
+template<typename Key>
+void radix_sort(Key* keys, size_t count) {
+    detail::radix_sort::sort<Key, detail::radix_sort::no_value>(keys, nullptr, count, 1, nullptr);
+}
+
+template<typename Key>
+void radix_sort(Key* keys, size_t count, parallel_for_ref parallel, size_t tasks = std::thread::hardware_concurrency()) {
+    detail::radix_sort::sort<Key, detail::radix_sort::no_value>(keys, nullptr, count, tasks, &parallel);
+}
+
+template<typename Key, typename Value>
+void radix_sort_pairs(Key* keys, Value* values, size_t count) {
+    detail::radix_sort::sort<Key, Value>(keys, values, count, 1, nullptr);
+}
+
+template<typename Key, typename Value>
+void radix_sort_pairs(Key* keys, Value* values, size_t count, parallel_for_ref parallel, size_t tasks = std::thread::hardware_concurrency()) {
+    detail::radix_sort::sort<Key, Value>(keys, values, count, tasks, &parallel);
+}
@@ -34,6 +34,7 @@
 //  FencePool pool;
 //  VkFence fence = pool.get(); // resource may be allocated if not already done
 //  pool.release(fence);        // resource is not destroyed, but rather put back into the pool
+//  pool.tryGet(fence);         // false rather than allocating when nothing is pooled
 //
 //
 // Another rather contrived example could be for allocating IDs
@@ -258,6 +259,19 @@ public:
         return ((AllocatorSubClass*)this)->allocate();
     }
 
+    // Only what's already pooled, never allocates
+    bool tryGet(T& value)
+    {
+        Resource* resource = freeResources.pop();
+        if(resource)
+        {
+            value = resource->value;
+            memoryPool.release(resource);
+            return true;
+        }
+        return false;
+    }
+
 private:
     struct Resource
     {
@@ -1,15 +1,388 @@
+#pragma once
+
+// Picking the best version of a function for the CPU we're actually running on, so the
+// same binary gets AVX2 / AVX-512 where available and still runs everywhere else.
+//
+// Variants are compiled in the same TU with MULTIVERSION_TARGET_* (gcc / clang need the
+// target attribute to allow the intrinsics, msvc allows them regardless), then put in a
+// table, from which the best supported variant is picked on the first call:
+//
+//  MULTIVERSION_TARGET_AVX2 void sum_avx2(const float* p, size_t n, float* out) { ... }
+//  void sum_scalar(const float* p, size_t n, float* out) { ... }
+//
+//  inline constinit multiversion<void(const float*, size_t, float*)> sum {
+//      {isa::scalar, sum_scalar},
+//      {isa::avx2, sum_avx2},
+//  };
+//
+//  sum(p, n, &out);
+//
+// The table is constant initialised (constinit), so it is safe to call from other static
+// initialisers, and calling it costs a (well predicted) null check plus an indirect call,
+// so multiversion whole loops rather than tiny per element functions.
+//
+// Levels roughly follow the x86-64 microarchitecture levels:
+//
+//  scalar      no SIMD (and what everything other than x86 gets)
+//  sse2        x86-64 baseline
+//  sse41       + SSE3 / SSSE3 / SSE4.1 / SSE4.2 / POPCNT
+//  avx2        + AVX / AVX2 / BMI1 / BMI2 / FMA / F16C / LZCNT / MOVBE (x86-64-v3)
+//  avx512      + AVX-512 F / BW / DQ / VL (x86-64-v4)
+//
+// Testing: RUNTIME_ISA=sse2 (etc) in the environment caps the level used by every
+// multiversion (read once, on first detection), set_isa_limit does the same in code
+// (followed by reset() on anything which has already been called), and
+// for_each_variant / force let tests run each supported variant in turn:
+//
+//  sum.for_each_variant([&](isa level, auto fn){ fn(p, n, &out); check(out, level); });
+//
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
 #include <utility>
 
+#if defined(_MSC_VER) && defined(_M_X64)
+    #include <intrin.h>
+    #define MULTIVERSION_X86 1
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <cpuid.h>
+    #define MULTIVERSION_X86 1
+#else
+    #define MULTIVERSION_X86 0
+#endif
+
+#if MULTIVERSION_X86 && (defined(__GNUC__) || defined(__clang__))
+    #define MULTIVERSION_TARGET_SSE2    __attribute__((target("sse2")))
+    #define MULTIVERSION_TARGET_SSE41   __attribute__((target("sse2,sse3,ssse3,sse4.1,sse4.2,popcnt")))
+    #define MULTIVERSION_TARGET_AVX2    __attribute__((target("sse2,sse3,ssse3,sse4.1,sse4.2,popcnt,avx,avx2,bmi,bmi2,fma,f16c,lzcnt,movbe")))
+    #define MULTIVERSION_TARGET_AVX512  __attribute__((target("sse2,sse3,ssse3,sse4.1,sse4.2,popcnt,avx,avx2,bmi,bmi2,fma,f16c,lzcnt,movbe,avx512f,avx512bw,avx512dq,avx512vl")))
+#else
+    #define MULTIVERSION_TARGET_SSE2
+    #define MULTIVERSION_TARGET_SSE41
+    #define MULTIVERSION_TARGET_AVX2
+    #define MULTIVERSION_TARGET_AVX512
+#endif
+
+
+enum class isa : uint8_t
+{
+    scalar,
+    sse2,
+    sse41,
+    avx2,
+    avx512,
+
+    count
+};
+
+
+inline const char* isa_name(const isa level)
+{
+    switch(level)
+    {
+        case isa::scalar:   return "scalar";
+        case isa::sse2:     return "sse2";
+        case isa::sse41:    return "sse41";
+        case isa::avx2:     return "avx2";
+        case isa::avx512:   return "avx512";
+        default:            return "unknown";
+    }
+}
+
+
+struct cpu_features
+{
+    bool sse2 = false;
+    bool sse3 = false;
+    bool ssse3 = false;
+    bool sse41 = false;
+    bool sse42 = false;
+    bool popcnt = false;
+    bool avx = false;           // Including OS support for the ymm state
+    bool avx2 = false;
+    bool bmi1 = false;
+    bool bmi2 = false;
+    bool fma = false;
+    bool f16c = false;
+    bool lzcnt = false;
+    bool movbe = false;
+    bool avx512f = false;       // Including OS support for the zmm / mask state
+    bool avx512bw = false;
+    bool avx512dq = false;
+    bool avx512vl = false;
+
+    isa     best = isa::scalar; // Highest level which is fully supported
+};
+
+
+namespace detail::runtime_function_loading
+{
+
+#if MULTIVERSION_X86
+inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#if defined(_MSC_VER)
+    int values[4];
+    __cpuidex(values, int(leaf), int(subleaf));
+    for(int i=0; i<4; ++i) { regs[i] = uint32_t(values[i]); }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+inline uint64_t xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    // Avoids needing -mxsave for _xgetbv
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (uint64_t(edx) << 32) | eax;
+#endif
+}
+#endif
+
+inline cpu_features detect()
+{
+    cpu_features f;
+#if MULTIVERSION_X86
+    uint32_t regs[4];
+    cpuid(0, 0, regs);
+    const uint32_t maxLeaf = regs[0];
+    cpuid(0x80000000u, 0, regs);
+    const uint32_t maxExtendedLeaf = regs[0];
+
+    cpuid(1, 0, regs);
+    const uint32_t ecx1 = regs[2];
+    const uint32_t edx1 = regs[3];
+    f.sse2 = (edx1 >> 26) & 1;
+    f.sse3 = (ecx1 >> 0) & 1;
+    f.ssse3 = (ecx1 >> 9) & 1;
+    f.fma = (ecx1 >> 12) & 1;
+    f.sse41 = (ecx1 >> 19) & 1;
+    f.sse42 = (ecx1 >> 20) & 1;
+    f.movbe = (ecx1 >> 22) & 1;
+    f.popcnt = (ecx1 >> 23) & 1;
+    f.f16c = (ecx1 >> 29) & 1;
+
+    // The OS has to save the ymm / zmm state for us to use it
+    const bool osxsave = (ecx1 >> 27) & 1;
+    const uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+    const bool ymmState = (xcr0 & 0x6) == 0x6;
+    const bool zmmState = (xcr0 & 0xe6) == 0xe6;
+    f.avx = ((ecx1 >> 28) & 1) && ymmState;
+    f.fma &= f.avx;
+    f.f16c &= f.avx;
+
+    if(maxLeaf >= 7)
+    {
+        cpuid(7, 0, regs);
+        const uint32_t ebx7 = regs[1];
+        f.bmi1 = (ebx7 >> 3) & 1;
+        f.avx2 = ((ebx7 >> 5) & 1) && f.avx;
+        f.bmi2 = (ebx7 >> 8) & 1;
+        f.avx512f = ((ebx7 >> 16) & 1) && zmmState;
+        f.avx512dq = ((ebx7 >> 17) & 1) && f.avx512f;
+        f.avx512bw = ((ebx7 >> 30) & 1) && f.avx512f;
+        f.avx512vl = ((ebx7 >> 31) & 1) && f.avx512f;
+    }
+    if(maxExtendedLeaf >= 0x80000001u)
+    {
+        cpuid(0x80000001u, 0, regs);
+        f.lzcnt = (regs[2] >> 5) & 1;
+    }
+
+    if(f.sse2)
+    {
+        f.best = isa::sse2;
+    }
+    if(f.best == isa::sse2 && f.sse3 && f.ssse3 && f.sse41 && f.sse42 && f.popcnt)
+    {
+        f.best = isa::sse41;
+    }
+    if(f.best == isa::sse41 && f.avx2 && f.bmi1 && f.bmi2 && f.fma && f.f16c && f.lzcnt && f.movbe)
+    {
+        f.best = isa::avx2;
+    }
+    if(f.best == isa::avx2 && f.avx512f && f.avx512bw && f.avx512dq && f.avx512vl)
+    {
+        f.best = isa::avx512;
+    }
+#endif
+    return f;
+}
+
+inline isa limitFromEnvironment()
+{
+    const char* value = std::getenv("RUNTIME_ISA");
+    if(value)
+    {
+        for(uint8_t i=0; i<uint8_t(isa::count); ++i)
+        {
+            if(std::strcmp(value, isa_name(isa(i))) == 0) { return isa(i); }
+        }
+    }
+    return isa(uint8_t(isa::count) - 1);
+}
+
+inline std::atomic<isa>& limit()
+{
+    static std::atomic<isa> value{limitFromEnvironment()};
+    return value;
+}
+
+// Not constexpr, so a constinit table without a baseline variant fails to compile
+inline void missing_baseline_variant()
+{
+    std::fputs("multiversion: needs an isa::scalar or isa::sse2 variant\n", stderr);
+    std::abort();
+}
+
+} // namespace detail::runtime_function_loading
 
-using function_type = decltype(std::declval<void (&)(const char*)noexcept>());
 
+inline const cpu_features& get_cpu_features()
+{
+    static const cpu_features features = detail::runtime_function_loading::detect();
+    return features;
+}
 
-function_type get_best_func();
-function_type func = get_best_func();
+// Highest level multiversion functions will use (the cpu's best, capped by the limit)
+inline isa get_best_isa()
+{
+    const isa best = get_cpu_features().best;
+    const isa limit = detail::runtime_function_loading::limit().load(std::memory_order_relaxed);
+    return uint8_t(best) < uint8_t(limit) ? best : limit;
+}
 
+inline bool isa_supported(const isa level)
+{
+    return uint8_t(level) <= uint8_t(get_cpu_features().best);
+}
 
-void doit(const char* s) noexcept {
-    func(s);
+// Caps the level used by multiversion functions resolved after this
+inline void set_isa_limit(const isa level)
+{
+    detail::runtime_function_loading::limit().store(level, std::memory_order_relaxed);
 }
 
 
+template<typename Signature>
+class multiversion;
+
+template<typename R, typename... Args>
+class multiversion<R(Args...)>
+{
+public:
+    using function_type = R(*)(Args...);
+
+    // Must have at least an isa::scalar (or isa::sse2 if only ever targeting x86) variant
+    constexpr multiversion(std::initializer_list<std::pair<isa, function_type>> variants)
+    {
+        bool baseline = false;
+        for(const auto& variant : variants)
+        {
+            m_variants[size_t(variant.first)] = variant.second;
+            baseline |= variant.first == isa::scalar || variant.first == isa::sse2;
+        }
+        if(!baseline)
+        {
+            detail::runtime_function_loading::missing_baseline_variant();
+        }
+    }
+
+    multiversion(const multiversion&) = delete;
+    multiversion& operator=(const multiversion&) = delete;
+
+    R operator()(Args... args) const
+    {
+        function_type function = m_selected.load(std::memory_order_relaxed);
+        if(!function) [[unlikely]]
+        {
+            function = resolve();
+        }
+        return function(std::forward<Args>(args)...);
+    }
+
+    // Picks (and caches) the best variant under get_best_isa(), RUNTIME_ISA=scalar can't
+    // take an x86 only table below its isa::sse2 variant
+    function_type resolve() const
+    {
+        function_type function = best_variant(get_best_isa());
+        if(!function)
+        {
+            function = m_variants[size_t(isa::sse2)];
+        }
+        m_selected.store(function, std::memory_order_relaxed);
+        return function;
+    }
+
+    // Forgets the cached choice, so the next call resolves again
+    void reset() const
+    {
+        m_selected.store(nullptr, std::memory_order_relaxed);
+    }
+
+    // Uses the best variant at or below level, returns false if there isn't a runnable one
+    bool force(const isa level) const
+    {
+        const isa capped = uint8_t(level) < uint8_t(get_cpu_features().best) ? level : get_cpu_features().best;
+        const function_type function = best_variant(capped);
+        if(!function)
+        {
+            return false;
+        }
+        m_selected.store(function, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Variant for exactly this level, or nullptr
+    function_type variant(const isa level) const
+    {
+        return m_variants[size_t(level)];
+    }
+
+    // The isa of the currently selected variant (resolving it if needed)
+    isa selected() const
+    {
+        function_type function = m_selected.load(std::memory_order_relaxed);
+        if(!function) { function = resolve(); }
+        for(size_t i=0; i<m_variants.size(); ++i)
+        {
+            if(m_variants[i] == function) { return isa(i); }
+        }
+        return isa::scalar;
+    }
+
+    // Calls callback(isa, function_type) for every variant this cpu can run
+    template<typename Callback>
+    void for_each_variant(Callback&& callback) const
+    {
+        for(size_t i=0; i<m_variants.size(); ++i)
+        {
+            if(m_variants[i] && isa_supported(isa(i)))
+            {
+                callback(isa(i), m_variants[i]);
+            }
+        }
+    }
+
+private:
+    function_type best_variant(const isa level) const
+    {
+        for(int i=int(level); i>=0; --i)
+        {
+            if(m_variants[size_t(i)]) { return m_variants[size_t(i)]; }
+        }
+        return nullptr;
+    }
+
+    std::array<function_type, size_t(isa::count)>   m_variants = {};
+    mutable std::atomic<function_type>              m_selected{nullptr};
+};
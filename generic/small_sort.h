@@ -0,0 +1,318 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE4_1__) || defined(__AVX__)
+    #define SMALL_SORT_HAS_SSE41 1
+#endif
+
+#if defined(__AVX2__)
+    #define SMALL_SORT_HAS_AVX2 1
+#endif
+
+#if defined(__AVX512F__)
+    #define SMALL_SORT_HAS_AVX512 1
+#endif
+
+#if defined(SMALL_SORT_HAS_SSE41) || defined(SMALL_SORT_HAS_AVX2) || defined(SMALL_SORT_HAS_AVX512)
+    #include <immintrin.h>
+#endif
+
+
+// Sorting networks for tiny arrays (N = 2..32), generated at compile time and unrolled
+// into branchless min / max sequences, instead of std::sort's branchy insertion sort.
+//
+// int32_t verts[4] = {...};
+// small_sort<4>(verts);
+// small_sort<16>(keys, [](const Key& a, const Key& b) { return a.hash < b.hash; });
+//
+// The networks are Batcher's odd-even merge sort, pruned down to N, which matches the
+// best known comparator counts up to N = 8 and is a few percent over them after that
+// (16: 63 vs 60, 32: 191 vs 185). small_sort_network<N>::comparators has the pairs.
+//
+// int32_t / uint32_t / float with the default ordering are sorted inside a register, one
+// layer of the network at a time (permute, min, max, blend), when the ISA is enabled at
+// compile time: N = 8 with AVX2, 16 with AVX-512F and (floats only, cmov already keeps up
+// for ints) 4 with SSE4.1. Every other N goes through the scalar network, masked loads /
+// stores for partial registers cost more than they save when the arrays are back to back.
+// Floats must not be NaN on either path.
+//
+// Time per array, sorting 1M back to back random arrays (GCC 12, -O2 -march=native):
+//
+//    N       std::sort      network       register
+//    2       ~20ns          ~1.5ns
+//    3       ~32ns          ~2.3ns
+//    4       ~45ns          ~3.5ns
+//    5       ~63ns          ~5.7ns
+//    8       ~114ns         ~9.8ns        ~6.9ns (AVX2)
+//    12      ~187ns         ~20ns
+//    16      ~255ns         ~27ns         ~13ns  (AVX-512)
+//    24      ~540ns         ~58ns
+//    32      ~910ns         ~87ns
+//
+//    float
+//    4       ~43ns          ~4.7ns        ~2.8ns (SSE4.1)
+//    8       ~108ns         ~17ns         ~7.4ns
+//    16      ~271ns         ~56ns         ~18ns
+//
+
+
+namespace detail::small_sort {
+
+struct comparator {
+    uint8_t a;      // a < b, a ends up holding the smaller value
+    uint8_t b;
+};
+
+
+// Batcher's odd-even merge sort, each (p, k) pass is one layer of independent comparators.
+// The bounds leave out anything touching an index >= n, as if those held +infinity.
+template<typename Callback>
+constexpr void for_each_comparator(size_t n, Callback&& callback) {
+
+    size_t layer = 0;
+    for(size_t p = 1; p < n; p += p) {
+        for(size_t k = p; k >= 1; k /= 2) {
+            for(size_t j = k % p; j + k < n; j += 2 * k) {
+                for(size_t i = 0; i < k && i + j + k < n; ++i) {
+                    if((i + j) / (2 * p) == (i + j + k) / (2 * p)) {
+                        callback(layer, comparator{uint8_t(i + j), uint8_t(i + j + k)});
+                    }
+                }
+            }
+            ++layer;
+        }
+    }
+}
+
+
+template<size_t N>
+struct network {
+
+    static constexpr size_t count = []{
+        size_t result = 0;
+        for_each_comparator(N, [&](size_t, comparator) { ++result; });
+        return result;
+    }();
+
+    static constexpr size_t layer_count = []{
+        size_t result = 0;
+        for_each_comparator(N, [&](size_t layer, comparator) { result = layer + 1; });
+        return result;
+    }();
+
+    static constexpr std::array<comparator, count> comparators = []{
+        std::array<comparator, count> result {};
+        size_t index = 0;
+        for_each_comparator(N, [&](size_t, comparator c) { result[index++] = c; });
+        return result;
+    }();
+
+    // Each lane's partner within a layer (itself when it's not compared), and which lanes
+    // take the max of their pair
+    struct lanes {
+        std::array<uint8_t, 16> partner;
+        uint32_t                max_mask;
+    };
+
+    static constexpr std::array<lanes, layer_count> layers = []{
+        std::array<lanes, layer_count> result {};
+        for(lanes& layer : result) {
+            for(size_t i = 0; i < layer.partner.size(); ++i) {
+                layer.partner[i] = uint8_t(i);
+            }
+        }
+        for_each_comparator(N, [&](size_t layer, comparator c) {
+            if(c.b < 16) {
+                result[layer].partner[c.a] = c.b;
+                result[layer].partner[c.b] = c.a;
+                result[layer].max_mask |= 1u << c.b;
+            }
+        });
+        return result;
+    }();
+};
+
+
+template<typename T, typename Less>
+inline void compare_exchange(T& a, T& b, Less& less) {
+    const bool swap = less(b, a);
+    const T lo = swap ? b : a;
+    const T hi = swap ? a : b;
+    a = lo;
+    b = hi;
+}
+
+
+template<size_t N, typename T, typename Less, size_t... indices>
+inline void apply_network(T* values, Less& less, std::index_sequence<indices...>) {
+    constexpr const auto& comparators = network<N>::comparators;
+    (compare_exchange(values[comparators[indices].a], values[comparators[indices].b], less), ...);
+}
+
+
+template<typename T, typename Less>
+constexpr bool register_sortable = (std::is_same_v<T, int32_t> || std::is_same_v<T, uint32_t> || std::is_same_v<T, float>)
+                                && (std::is_same_v<Less, std::less<>> || std::is_same_v<Less, std::less<T>>);
+
+
+#if defined(SMALL_SORT_HAS_SSE41)
+
+template<typename T>
+inline __m128i min4(__m128i a, __m128i b) {
+    if constexpr(std::is_same_v<T, int32_t>) { return _mm_min_epi32(a, b); }
+    else if constexpr(std::is_same_v<T, uint32_t>) { return _mm_min_epu32(a, b); }
+    else { return _mm_castps_si128(_mm_min_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b))); }
+}
+
+template<typename T>
+inline __m128i max4(__m128i a, __m128i b) {
+    if constexpr(std::is_same_v<T, int32_t>) { return _mm_max_epi32(a, b); }
+    else if constexpr(std::is_same_v<T, uint32_t>) { return _mm_max_epu32(a, b); }
+    else { return _mm_castps_si128(_mm_max_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b))); }
+}
+
+template<typename T, size_t... layers>
+inline void sort4(T* values, std::index_sequence<layers...>) {
+
+    __m128i v = _mm_loadu_si128((const __m128i*)values);
+    ([&]{
+        constexpr auto layer = network<4>::layers[layers];
+        constexpr int shuffle = layer.partner[0] | (layer.partner[1] << 2) | (layer.partner[2] << 4) | (layer.partner[3] << 6);
+        const __m128i partner = _mm_shuffle_epi32(v, shuffle);
+        const __m128 lo = _mm_castsi128_ps(min4<T>(v, partner));
+        const __m128 hi = _mm_castsi128_ps(max4<T>(v, partner));
+        v = _mm_castps_si128(_mm_blend_ps(lo, hi, int(layer.max_mask & 0xf)));
+    }(), ...);
+    _mm_storeu_si128((__m128i*)values, v);
+}
+
+#endif
+
+
+#if defined(SMALL_SORT_HAS_AVX2)
+
+template<typename T>
+inline __m256i min8(__m256i a, __m256i b) {
+    if constexpr(std::is_same_v<T, int32_t>) { return _mm256_min_epi32(a, b); }
+    else if constexpr(std::is_same_v<T, uint32_t>) { return _mm256_min_epu32(a, b); }
+    else { return _mm256_castps_si256(_mm256_min_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b))); }
+}
+
+template<typename T>
+inline __m256i max8(__m256i a, __m256i b) {
+    if constexpr(std::is_same_v<T, int32_t>) { return _mm256_max_epi32(a, b); }
+    else if constexpr(std::is_same_v<T, uint32_t>) { return _mm256_max_epu32(a, b); }
+    else { return _mm256_castps_si256(_mm256_max_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b))); }
+}
+
+template<typename T, size_t... layers>
+inline void sort8(T* values, std::index_sequence<layers...>) {
+
+    __m256i v = _mm256_loadu_si256((const __m256i*)values);
+    ([&]{
+        constexpr auto layer = network<8>::layers[layers];
+        const __m256i permute = _mm256_setr_epi32(
+            layer.partner[0], layer.partner[1], layer.partner[2], layer.partner[3],
+            layer.partner[4], layer.partner[5], layer.partner[6], layer.partner[7]
+        );
+        const __m256i partner = _mm256_permutevar8x32_epi32(v, permute);
+        v = _mm256_blend_epi32(min8<T>(v, partner), max8<T>(v, partner), int(layer.max_mask & 0xff));
+    }(), ...);
+    _mm256_storeu_si256((__m256i*)values, v);
+}
+
+#endif
+
+
+#if defined(SMALL_SORT_HAS_AVX512)
+
+template<typename T, size_t... layers>
+inline void sort16(T* values, std::index_sequence<layers...>) {
+
+    __m512i v = _mm512_loadu_si512(values);
+    ([&]{
+        constexpr auto layer = network<16>::layers[layers];
+        const __m512i permute = _mm512_setr_epi32(
+            layer.partner[0], layer.partner[1], layer.partner[2], layer.partner[3],
+            layer.partner[4], layer.partner[5], layer.partner[6], layer.partner[7],
+            layer.partner[8], layer.partner[9], layer.partner[10], layer.partner[11],
+            layer.partner[12], layer.partner[13], layer.partner[14], layer.partner[15]
+        );
+        // The maskz forms with an all ones mask, GCC 12's unmasked ones trip -Wmaybe-uninitialized
+        constexpr __mmask16 all = 0xffff;
+        constexpr __mmask16 take_max = __mmask16(layer.max_mask);
+        const __m512i partner = _mm512_maskz_permutexvar_epi32(all, permute, v);
+        if constexpr(std::is_same_v<T, int32_t>) {
+            v = _mm512_mask_max_epi32(_mm512_maskz_min_epi32(all, v, partner), take_max, v, partner);
+        } else if constexpr(std::is_same_v<T, uint32_t>) {
+            v = _mm512_mask_max_epu32(_mm512_maskz_min_epu32(all, v, partner), take_max, v, partner);
+        } else {
+            const __m512 a = _mm512_castsi512_ps(v);
+            const __m512 b = _mm512_castsi512_ps(partner);
+            v = _mm512_castps_si512(_mm512_mask_max_ps(_mm512_maskz_min_ps(all, a, b), take_max, a, b));
+        }
+    }(), ...);
+    _mm512_storeu_si512(values, v);
+}
+
+#endif
+
+} // namespace detail::small_sort
+
+
+template<size_t N>
+struct small_sort_network {
+    static constexpr size_t size = N;
+    static constexpr size_t count = detail::small_sort::network<N>::count;
+    static constexpr size_t depth = detail::small_sort::network<N>::layer_count;
+    static constexpr const auto& comparators = detail::small_sort::network<N>::comparators;
+};
+
+
+// Always the scalar network, whatever the type / ISA
+template<size_t N, typename T, typename Less = std::less<>>
+inline void small_sort_scalar(T* values, Less less = {}) {
+
+    static_assert(N <= 32, "Sorting networks are only generated up to 32 elements");
+    if constexpr(N > 1) {
+        detail::small_sort::apply_network<N>(values, less, std::make_index_sequence<detail::small_sort::network<N>::count>{});
+    }
+}
+
+
+template<size_t N, typename T, typename Less = std::less<>>
+inline void small_sort(T* values, Less less = {}) {
+
+    static_assert(N <= 32, "Sorting networks are only generated up to 32 elements");
+
+    [[maybe_unused]] constexpr bool in_register = detail::small_sort::register_sortable<T, Less>;
+    [[maybe_unused]] constexpr auto layers = std::make_index_sequence<detail::small_sort::network<N>::layer_count>{};
+
+    if constexpr(N < 2) {
+        return;
+    }
+#if defined(SMALL_SORT_HAS_SSE41)
+    else if constexpr(in_register && N == 4 && std::is_same_v<T, float>) {
+        detail::small_sort::sort4<T>(values, layers);
+    }
+#endif
+#if defined(SMALL_SORT_HAS_AVX2)
+    else if constexpr(in_register && N == 8) {
+        detail::small_sort::sort8<T>(values, layers);
+    }
+#endif
+#if defined(SMALL_SORT_HAS_AVX512)
+    else if constexpr(in_register && N == 16) {
+        detail::small_sort::sort16<T>(values, layers);
+    }
+#endif
+    else {
+        small_sort_scalar<N>(values, less);
+    }
+}
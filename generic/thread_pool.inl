@@ -19,6 +19,12 @@
 //
 // setThreadCount(n); // Must be called before doing things.
 //
+// With THREAD_POOL_ENABLE_LATENCY_HISTOGRAMS, queue latency (enqueue to start) and run
+// time of every task are recorded in nanoseconds:
+//
+// LatencyHistogram<> queued = GLOBAL_THREAD_POOL.taskQueueLatencyNs();
+// queued.percentile(0.99);
+//
 
 
 /////////////////////////////////////////////////////
@@ -36,13 +42,25 @@
 #include <thread>
 #include <vector>
 #include <set>
+#include <type_traits>
 #include <utility>
 #include <condition_variable>
 
+#include "small_function.h"
+
 
 // Useful for debugging when you want break-all
 #define THREAD_POOL_ENABLE_WAIT_COUNTERS 0
 
+// Per task latency / run time histograms, costs two clock reads and two records per task
+#ifndef THREAD_POOL_ENABLE_LATENCY_HISTOGRAMS
+    #define THREAD_POOL_ENABLE_LATENCY_HISTOGRAMS 0
+#endif
+
+#if THREAD_POOL_ENABLE_LATENCY_HISTOGRAMS
+    #include "latency_histogram.h"
+#endif
+
 
 using taskhandle_t = size_t;
 const static taskhandle_t INVALID_TASK_HANDLE = ~taskhandle_t(0);
@@ -50,36 +68,58 @@ const static taskhandle_t INVALID_TASK_HANDLE = ~taskhandle_t(0);
 
 class TaskPool {
 public:
-    struct Task {
-        virtual ~Task() = default;
-        virtual void execute(void) = 0;
-    };
+    // Closures up to this size are stored inline in the queue, bigger ones are boxed on the heap
+    static constexpr size_t TASK_INLINE_CAPACITY = 48;
+    using TaskFunction = small_function<void(void), TASK_INLINE_CAPACITY>;
 
 private:
     using shared_mutex = std::shared_timed_mutex;
 
-    // Task which upon completion, notifies the taskpool
+    // Upon completion, the taskpool is notified with the id
+    struct Task {
+        TaskFunction  m_func;
+        taskhandle_t  m_taskId = INVALID_TASK_HANDLE;
+#if THREAD_POOL_ENABLE_LATENCY_HISTOGRAMS
+        uint64_t      m_enqueuedNs = 0;
+#endif
+    };
+
     template<typename F>
-    struct TaskWithClosure : Task {
+    static TaskFunction makeTaskFunction(F&& f)
+    {
+        using Callable = std::decay_t<F>;
+        if constexpr(std::is_lvalue_reference_v<F>)
+        {
+            // Lvalues are referenced rather than copied, the caller keeps them alive until they've run
+            return [func = &f]{ (*func)(); };
+        }
+        else if constexpr(TaskFunction::fits<Callable>)
+        {
+            return TaskFunction(std::move(f));
+        }
+        else
+        {
+            return [func = std::make_unique<Callable>(std::move(f))]{ (*func)(); };
+        }
+    }
 
-    TaskWithClosure(F func, TaskPool* parentPool, const taskhandle_t taskId)
-    : m_func(std::move(func)), m_parentPool(parentPool), m_taskId(taskId)
-    {}
+    void taskClosure(const taskhandle_t taskId);
 
-    void execute(void) final
+#if THREAD_POOL_ENABLE_LATENCY_HISTOGRAMS
+    static uint64_t nowNs()
     {
-        m_func();
-        m_parentPool->taskClosure(m_taskId);
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count());
     }
 
-    private:
-        F m_func;
-        TaskPool* m_parentPool;
-        taskhandle_t  m_taskId;
-
-    };
+    ConcurrentLatencyHistogram<>       m_queueLatencyNs;
+    ConcurrentLatencyHistogram<>       m_runTimeNs;
 
-    void taskClosure(const taskhandle_t taskId);
+public:
+    LatencyHistogram<> queueLatencyNs() const { return m_queueLatencyNs.snapshot(); }
+    LatencyHistogram<> runTimeNs() const { return m_runTimeNs.snapshot(); }
+#endif
 
 public:
     // Attempt to run the next task, if there was no task, this returns false.
@@ -102,7 +142,7 @@ public:
             m_unrunIds.insert(id);
         }
 
-        std::unique_ptr<Task> task = allocateTask(std::forward<F>(f), id);
+        Task task = allocateTask(std::forward<F>(f), id);
         {
             std::lock_guard<std::mutex> guard(m_tasksLock);
             m_tasks.push_back(std::move(task));
@@ -127,7 +167,7 @@ public:
         auto tasks = allocateTasks(idRange.first, std::forward<Fs>(fs)...);
         {
             std::lock_guard<std::mutex> guard(m_tasksLock);
-            for(std::unique_ptr<Task>& task : tasks)
+            for(Task& task : tasks)
             {
                 m_tasks.push_back(std::move(task));
             }
@@ -146,17 +186,17 @@ private:
 
     // Allocate tasks
     template<typename F>
-    std::unique_ptr<Task> allocateTask(F&& f, const taskhandle_t taskId)
+    Task allocateTask(F&& f, const taskhandle_t taskId)
     {
-        return std::make_unique<TaskWithClosure<F>>(
-            std::forward<F>(f),
-            this,
-            taskId
-        );
+#if THREAD_POOL_ENABLE_LATENCY_HISTOGRAMS
+        return Task{makeTaskFunction(std::forward<F>(f)), taskId, nowNs()};
+#else
+        return Task{makeTaskFunction(std::forward<F>(f)), taskId};
+#endif
     }
 
     template<typename... Fs>
-    std::array<std::unique_ptr<Task>, sizeof...(Fs)> allocateTasks(const taskhandle_t startingTaskId, Fs&&... fs)
+    std::array<Task, sizeof...(Fs)> allocateTasks(const taskhandle_t startingTaskId, Fs&&... fs)
     {
         taskhandle_t currentId = startingTaskId;
         return {
@@ -166,7 +206,7 @@ private:
 
     std::atomic<taskhandle_t>          m_taskIdIota {0};
     std::mutex                         m_tasksLock;
-    std::vector<std::unique_ptr<Task>> m_tasks;
+    std::vector<Task>                  m_tasks;
 
     mutable shared_mutex               m_unrunIdsLock;
     std::set<taskhandle_t>             m_unrunIds;
@@ -344,6 +384,12 @@ public:
         }
     }
 
+#if THREAD_POOL_ENABLE_LATENCY_HISTOGRAMS
+    // Snapshots, nanoseconds from enqueue to starting / for running
+    LatencyHistogram<> taskQueueLatencyNs() const { return m_taskPool.queueLatencyNs(); }
+    LatencyHistogram<> taskRunTimeNs() const { return m_taskPool.runTimeNs(); }
+#endif
+
     void setThreadCount(const uint32_t threadCount)
     {
         if(m_launchedThreads)
@@ -441,7 +487,7 @@ ThreadedTaskPool GLOBAL_THREAD_POOL;
 
 bool TaskPool::runNextTask()
 {
-    std::unique_ptr<Task> task;
+    Task task;
 
     if(!hasTasks()) { return false; }
 
@@ -452,7 +498,15 @@ bool TaskPool::runNextTask()
         m_tasks.pop_back();
     }
 
-    task->execute();
+#if THREAD_POOL_ENABLE_LATENCY_HISTOGRAMS
+    const uint64_t start = nowNs();
+    m_queueLatencyNs.record(start - task.m_enqueuedNs);
+    task.m_func();
+    m_runTimeNs.record(nowNs() - start);
+#else
+    task.m_func();
+#endif
+    taskClosure(task.m_taskId);
     return true;
 }
 
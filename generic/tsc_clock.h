@@ -0,0 +1,237 @@
+#pragma once
+
+// Converting TSC ticks into time, and checking they can be trusted.
+//
+//  const TscClock& clock = tscClock();     // Calibrates on first use (~30ms), do it at startup
+//  uint64_t start = clock.now();
+//  ...
+//  double ns = clock.toNs(clock.now() - start);
+//
+// The TSC frequency is calibrated against CLOCK_MONOTONIC_RAW (which isn't slewed by NTP),
+// sampling each side between two rdtscp's and keeping the tightest bracket. It's only
+// used when the CPU reports an invariant TSC (constant rate through P/C states) and the
+// per core TSCs agree with each other (checked by pinning a thread to every core the
+// process may run on, and comparing their offsets from the same clock), otherwise now()
+// falls back to clock_gettime and its "ticks" are simply nanoseconds, so toNs works the
+// same either way.
+//
+// For short measurements plain rdtsc can be reordered with the code being measured,
+// rdtscBegin / rdtscEnd (lfence + rdtsc, rdtscp + lfence) stop that, at the cost of
+// ~20 cycles more overhead.
+//
+// Only linux gets the cross core check, elsewhere an invariant TSC is assumed synchronised.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+    #include <intrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <x86intrin.h>
+    #include <cpuid.h>
+#else
+    #error "Only really intended for x64 gcc/clang/msc"
+#endif
+
+#if defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+    #include <time.h>
+#endif
+
+
+class TscClock
+{
+public:
+    TscClock()
+    {
+        m_invariant = hasInvariantTsc();
+        if(!m_invariant)
+        {
+            return;
+        }
+        m_calibrated = calibrate();
+        m_synchronised = m_calibrated && checkSynchronised();
+        m_usingTsc = m_calibrated && m_synchronised;
+        m_nsPerTick = m_usingTsc ? m_tscNsPerTick : 1.0;
+    }
+
+    // Serialised reads, nothing before begin / after end can drift into the measurement
+    static uint64_t rdtscBegin()
+    {
+        _mm_lfence();
+        const uint64_t value = __rdtsc();
+        _mm_lfence();
+        return value;
+    }
+
+    static uint64_t rdtscEnd()
+    {
+        unsigned int aux;
+        const uint64_t value = __rdtscp(&aux);
+        _mm_lfence();
+        return value;
+    }
+
+    // CLOCK_MONOTONIC_RAW in nanoseconds (steady_clock outside linux)
+    static uint64_t rawNs()
+    {
+#if defined(__linux__)
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+#else
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    // Ticks, either the TSC or nanoseconds when falling back
+    uint64_t now() const
+    {
+        return m_usingTsc ? __rdtsc() : rawNs();
+    }
+
+    double toNs(uint64_t ticks) const { return double(ticks) * m_nsPerTick; }
+    double toNs(int64_t ticks) const { return double(ticks) * m_nsPerTick; }
+    uint64_t nowNs() const { return uint64_t(toNs(now())); }
+
+    bool invariant() const { return m_invariant; }
+    bool synchronised() const { return m_synchronised; }
+    bool usingTsc() const { return m_usingTsc; }
+
+    // Measured TSC frequency, 0 if it wasn't calibrated
+    double tscHz() const { return m_calibrated ? 1e9 / m_tscNsPerTick : 0.0; }
+
+    // For converting raw rdtsc values (e.g from measure_cycles2) regardless of fallback,
+    // 0 if the TSC wasn't calibrated
+    double tscToNs(int64_t ticks) const { return m_calibrated ? double(ticks) * m_tscNsPerTick : 0.0; }
+
+    // Largest offset between any two cores, in ns (0 if not checked)
+    double maxCoreSkewNs() const { return m_maxSkewNs; }
+
+private:
+    struct Pair
+    {
+        double  tsc;        // Middle of the bracket
+        double  ns;
+        int64_t width;      // Bracket width in ticks
+    };
+
+    static Pair samplePair()
+    {
+        Pair best{0.0, 0.0, INT64_MAX};
+        for(int i=0; i<16; ++i)
+        {
+            const uint64_t before = rdtscEnd();
+            const uint64_t ns = rawNs();
+            const uint64_t after = rdtscEnd();
+            if(int64_t(after - before) < best.width)
+            {
+                best = Pair{0.5 * (double(before) + double(after)), double(ns), int64_t(after - before)};
+            }
+        }
+        return best;
+    }
+
+    static bool hasInvariantTsc()
+    {
+#if defined(_MSC_VER)
+        int regs[4];
+        __cpuid(regs, 0x80000000);
+        if(uint32_t(regs[0]) < 0x80000007u) { return false; }
+        __cpuid(regs, 0x80000001);
+        const bool rdtscp = (regs[3] >> 27) & 1;
+        __cpuid(regs, 0x80000007);
+        return rdtscp && ((regs[3] >> 8) & 1);
+#else
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        if(__get_cpuid_max(0x80000000u, nullptr) < 0x80000007u) { return false; }
+        __get_cpuid(0x80000001u, &eax, &ebx, &ecx, &edx);
+        const bool rdtscp = (edx >> 27) & 1;
+        __get_cpuid(0x80000007u, &eax, &ebx, &ecx, &edx);
+        return rdtscp && ((edx >> 8) & 1);
+#endif
+    }
+
+    // Three 10ms rounds, which have to agree to within 0.1%
+    bool calibrate()
+    {
+        double rates[3];
+        for(double& rate : rates)
+        {
+            const Pair start = samplePair();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            const Pair end = samplePair();
+            if(end.ns <= start.ns || end.tsc <= start.tsc)
+            {
+                return false;
+            }
+            rate = (end.ns - start.ns) / (end.tsc - start.tsc);
+        }
+        std::sort(rates, rates + 3);
+        if((rates[2] - rates[0]) > rates[1] * 1e-3)
+        {
+            return false;
+        }
+        m_tscNsPerTick = rates[1];
+        return true;
+    }
+
+    bool checkSynchronised()
+    {
+#if defined(__linux__)
+        cpu_set_t allowed;
+        if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        {
+            return true;
+        }
+
+        // TSC ticks ahead of the clock, per core
+        std::vector<double> offsets;
+        double maxWidthNs = 0.0;
+        for(int cpu=0; cpu<CPU_SETSIZE; ++cpu)
+        {
+            if(!CPU_ISSET(cpu, &allowed)) { continue; }
+            std::thread thread([&, cpu]
+            {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpu, &set);
+                if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) { return; }
+                const Pair pair = samplePair();
+                offsets.push_back(pair.tsc * m_tscNsPerTick - pair.ns);
+                maxWidthNs = std::max(maxWidthNs, double(pair.width) * m_tscNsPerTick);
+            });
+            thread.join();
+        }
+        if(offsets.size() < 2)
+        {
+            return true;
+        }
+        const auto range = std::minmax_element(offsets.begin(), offsets.end());
+        m_maxSkewNs = *range.second - *range.first;
+        return m_maxSkewNs <= std::max(1000.0, 4.0 * maxWidthNs);
+#else
+        return true;
+#endif
+    }
+
+    double  m_nsPerTick = 1.0;
+    double  m_tscNsPerTick = 1.0;
+    double  m_maxSkewNs = 0.0;
+    bool    m_invariant = false;
+    bool    m_calibrated = false;
+    bool    m_synchronised = false;
+    bool    m_usingTsc = false;
+};
+
+
+inline const TscClock& tscClock()
+{
+    static const TscClock instance;
+    return instance;
+}
@@ -0,0 +1,474 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <type_traits>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+    #include <intrin.h>
+
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <x86intrin.h>
+
+#else
+    #error "Only really intended for x64 gcc/clang/msc"
+#endif
+
+#include "../generic/bsf.h"
+#include "../generic/runtime_function_loading.h"
+
+
+// Array versions of generic/all_the_same.h, for finding constant textures, vertex
+// attributes etc before compressing them, over elements of any size (1, 2, 4, 8, 16 bytes,
+// or structs) compared bitwise, so -0.0f != 0.0f and identical NaNs are equal.
+//
+// all_the_same(texels, count);                         // Everything equal to texels[0]
+// all_equal_to(normals, count, vec4{0, 0, 1, 0});
+// find_first_mismatch(indices, count, 0u);             // First index != 0, count if none
+// count_equal(heights, count, 0.0f);
+//
+// The _strided versions take the first element and the bytes between elements, e.g one
+// channel of an image, or one attribute of interleaved vertices:
+//
+// all_the_same_strided(&rgba[0].a, pixel_count, sizeof(rgba));   // Constant alpha?
+// count_equal_strided(&vertices[0].normal, vertex_count, sizeof(vertex), up);
+//
+// The value is repeated over whole registers (with the bytes between elements masked off),
+// so every element size and stride is compared 32 bytes at a time with AVX2, 16 with SSE2.
+// The pattern repeats every lcm(stride, 32) bytes, strides where that's more than 256 bytes
+// (e.g 36) go element by element. Mismatches exit after at most 128 more bytes.
+//
+// count_equal folds each element's compare bits together, which needs the elements lined
+// up with the registers, so strides of 1, 2, 4, 8, 16 or 32 bytes. Other strides count
+// element by element.
+//
+// All equal (so nothing exits early), 1 thread (GCC 12, -O2), GB/s of the elements:
+//
+//                                      scalar      SSE2        AVX2
+//    all_the_same   uint8_t, 64MB      ~6          ~7.5        ~8
+//    all_the_same   uint8_t, 32KB      ~10         ~26         ~31
+//    all_the_same   uint32_t, 64MB     ~6          ~7.5        ~8
+//    all_the_same   16 bytes, 64MB     ~6          ~7.8        ~8
+//    count_equal    uint8_t, 64MB      ~3.7        ~6          ~7.4
+//    count_equal    uint32_t, 64MB     ~2.9        ~5.6        ~6.2
+//    count_equal    uint8_t, 16KB      ~4.8        ~13         ~25
+//    all_the_same_strided, RGBA8 alpha ~5.8        ~7.7        ~8.3      (of the whole image)
+//    all_the_same_strided, 12 byte xyz ~5.7        ~7.5        ~8
+//
+// generic/all_the_same.h is ~6.7GB/s for 64MB and ~12-22GB/s for 32KB of uint8_t, past that
+// everything's memory bound. The scalar variant is 64 bit words.
+//
+
+
+namespace detail::all_the_same {
+
+// Longest repeat of value + gap bytes compared with whole registers
+constexpr size_t MAX_PERIOD = 256;
+
+// Registers (of register_bytes) before the pattern repeats, 0 if that's past MAX_PERIOD
+inline size_t pattern_registers(size_t stride, size_t register_bytes) {
+    const size_t period = std::lcm(stride, register_bytes);
+    return period <= MAX_PERIOD ? period / register_bytes : 0;
+}
+
+// Fills registers + 3 registers worth of the pattern (so four registers can be read from any
+// start below registers), the value's bytes in value, 0xff in ignore where they're between
+// elements
+inline void build_pattern(uint8_t* pattern, uint8_t* ignore, size_t registers, size_t register_bytes,
+                          const uint8_t* value, size_t width, size_t stride) {
+    // The period is a multiple of the stride, so the byte within the element is just i % stride
+    size_t within = 0;
+    for(size_t i = 0; i < (registers + 3) * register_bytes; ++i) {
+        pattern[i] = within < width ? value[within] : 0;
+        ignore[i] = within < width ? 0 : 0xff;
+        within = within + 1 == stride ? 0 : within + 1;
+    }
+}
+
+inline bool same_element(const uint8_t* a, const uint8_t* b, size_t width) {
+    switch(width) {
+        case 1: return *a == *b;
+        case 2: { uint16_t x, y; std::memcpy(&x, a, 2); std::memcpy(&y, b, 2); return x == y; }
+        case 4: { uint32_t x, y; std::memcpy(&x, a, 4); std::memcpy(&y, b, 4); return x == y; }
+        case 8: { uint64_t x, y; std::memcpy(&x, a, 8); std::memcpy(&y, b, 8); return x == y; }
+        default: return std::memcmp(a, b, width) == 0;
+    }
+}
+
+inline size_t mismatch_elements(const uint8_t* data, size_t first, size_t count, size_t stride, const uint8_t* value, size_t width) {
+    for(size_t i = first; i < count; ++i) {
+        if(!same_element(data + i * stride, value, width)) {
+            return i;
+        }
+    }
+    return count;
+}
+
+inline size_t count_elements(const uint8_t* data, size_t first, size_t count, size_t stride, const uint8_t* value, size_t width) {
+    size_t equal = 0;
+    for(size_t i = first; i < count; ++i) {
+        equal += same_element(data + i * stride, value, width);
+    }
+    return equal;
+}
+
+// Elements whose bytes all sit below offset
+inline size_t elements_before(size_t offset, size_t count, size_t stride, size_t width) {
+    if(offset < width) {
+        return 0;
+    }
+    const size_t covered = (offset - width) / stride + 1;
+    return covered < count ? covered : count;
+}
+
+// Bits at the start of each stride wide element, in a mask with one bit per byte
+inline uint64_t element_starts(size_t stride, size_t bits) {
+    uint64_t starts = 0;
+    for(size_t i = 0; i < bits; i += stride) {
+        starts |= uint64_t(1) << i;
+    }
+    return starts;
+}
+
+// The element's bits are all set, moved down to its first bit
+inline uint64_t fold_elements(uint64_t mask, size_t stride) {
+    for(size_t shift = 1; shift < stride; shift *= 2) {
+        mask &= mask >> shift;
+    }
+    return mask;
+}
+
+
+// 64 bit words, four per early exit check
+inline
+size_t mismatch_scalar(const uint8_t* data, size_t count, size_t stride, const uint8_t* value, size_t width) {
+
+    const size_t registers = pattern_registers(stride, 8);
+    if(count == 0 || registers == 0) {
+        return mismatch_elements(data, 0, count, stride, value, width);
+    }
+
+    uint8_t pattern_bytes[MAX_PERIOD + 3 * 8];
+    uint8_t ignore_bytes[MAX_PERIOD + 3 * 8];
+    build_pattern(pattern_bytes, ignore_bytes, registers, 8, value, width, stride);
+    uint64_t pattern[MAX_PERIOD / 8 + 3];
+    uint64_t care[MAX_PERIOD / 8 + 3];
+    std::memcpy(pattern, pattern_bytes, (registers + 3) * 8);
+    std::memcpy(care, ignore_bytes, (registers + 3) * 8);
+    for(size_t i = 0; i < registers + 3; ++i) {
+        care[i] = ~care[i];
+    }
+
+    const size_t bytes = (count - 1) * stride + width;
+    const size_t step = 4 % registers;
+    size_t offset = 0;
+    size_t r = 0;
+    for(; offset + 32 <= bytes; offset += 32) {
+        uint64_t words[4];
+        std::memcpy(words, data + offset, 32);
+        uint64_t diff[4];
+        for(size_t i = 0; i < 4; ++i) {
+            diff[i] = (words[i] ^ pattern[r + i]) & care[r + i];
+        }
+        if((diff[0] | diff[1] | diff[2] | diff[3]) != 0) {
+            for(size_t i = 0; i < 4; ++i) {
+                if(diff[i] != 0) {
+                    return (offset + i * 8 + bsf((unsigned long long)diff[i]) / 8) / stride;
+                }
+            }
+        }
+        r += step;
+        r -= r >= registers ? registers : 0;
+    }
+    for(; offset + 8 <= bytes; offset += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + offset, 8);
+        const uint64_t diff = (word ^ pattern[r]) & care[r];
+        if(diff != 0) {
+            return (offset + bsf((unsigned long long)diff) / 8) / stride;
+        }
+        r = r + 1 == registers ? 0 : r + 1;
+    }
+    return mismatch_elements(data, elements_before(offset, count, stride, width), count, stride, value, width);
+}
+
+
+// Equal or ignored bytes are all ones
+inline __m128i matches_sse2(const uint8_t* data, const uint8_t* pattern, const uint8_t* ignore, size_t r) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)data);
+    const __m128i equal = _mm_cmpeq_epi8(v, _mm_load_si128((const __m128i*)(pattern + r * 16)));
+    return _mm_or_si128(equal, _mm_load_si128((const __m128i*)(ignore + r * 16)));
+}
+
+inline
+size_t mismatch_sse2(const uint8_t* data, size_t count, size_t stride, const uint8_t* value, size_t width) {
+
+    const size_t registers = pattern_registers(stride, 16);
+    if(count == 0 || registers == 0) {
+        return mismatch_elements(data, 0, count, stride, value, width);
+    }
+
+    alignas(16) uint8_t pattern[MAX_PERIOD + 3 * 16];
+    alignas(16) uint8_t ignore[MAX_PERIOD + 3 * 16];
+    build_pattern(pattern, ignore, registers, 16, value, width, stride);
+
+    const size_t bytes = (count - 1) * stride + width;
+    const size_t step = 4 % registers;
+    size_t offset = 0;
+    size_t r = 0;
+    for(; offset + 64 <= bytes; offset += 64) {
+        const __m128i m0 = matches_sse2(data + offset + 0, pattern, ignore, r + 0);
+        const __m128i m1 = matches_sse2(data + offset + 16, pattern, ignore, r + 1);
+        const __m128i m2 = matches_sse2(data + offset + 32, pattern, ignore, r + 2);
+        const __m128i m3 = matches_sse2(data + offset + 48, pattern, ignore, r + 3);
+        const __m128i all = _mm_and_si128(_mm_and_si128(m0, m1), _mm_and_si128(m2, m3));
+        if(_mm_movemask_epi8(all) != 0xffff) {
+            const __m128i parts[4] = {m0, m1, m2, m3};
+            for(size_t i = 0; i < 4; ++i) {
+                const unsigned int mismatched = ~unsigned(_mm_movemask_epi8(parts[i])) & 0xffff;
+                if(mismatched != 0) {
+                    return (offset + i * 16 + bsf(mismatched)) / stride;
+                }
+            }
+        }
+        r += step;
+        r -= r >= registers ? registers : 0;
+    }
+    for(; offset + 16 <= bytes; offset += 16) {
+        const unsigned int mismatched = ~unsigned(_mm_movemask_epi8(matches_sse2(data + offset, pattern, ignore, r))) & 0xffff;
+        if(mismatched != 0) {
+            return (offset + bsf(mismatched)) / stride;
+        }
+        r = r + 1 == registers ? 0 : r + 1;
+    }
+    return mismatch_elements(data, elements_before(offset, count, stride, width), count, stride, value, width);
+}
+
+
+// Equal or ignored bytes are all ones
+MULTIVERSION_TARGET_AVX2 inline
+__m256i matches_avx2(const uint8_t* data, const uint8_t* pattern, const uint8_t* ignore, size_t r) {
+    const __m256i v = _mm256_loadu_si256((const __m256i*)data);
+    const __m256i equal = _mm256_cmpeq_epi8(v, _mm256_load_si256((const __m256i*)(pattern + r * 32)));
+    return _mm256_or_si256(equal, _mm256_load_si256((const __m256i*)(ignore + r * 32)));
+}
+
+MULTIVERSION_TARGET_AVX2 inline
+size_t mismatch_avx2(const uint8_t* data, size_t count, size_t stride, const uint8_t* value, size_t width) {
+
+    const size_t registers = pattern_registers(stride, 32);
+    if(count == 0 || registers == 0) {
+        return mismatch_elements(data, 0, count, stride, value, width);
+    }
+
+    alignas(32) uint8_t pattern[MAX_PERIOD + 3 * 32];
+    alignas(32) uint8_t ignore[MAX_PERIOD + 3 * 32];
+    build_pattern(pattern, ignore, registers, 32, value, width, stride);
+
+    const size_t bytes = (count - 1) * stride + width;
+    const size_t step = 4 % registers;
+    size_t offset = 0;
+    size_t r = 0;
+    for(; offset + 128 <= bytes; offset += 128) {
+        const __m256i m0 = matches_avx2(data + offset + 0, pattern, ignore, r + 0);
+        const __m256i m1 = matches_avx2(data + offset + 32, pattern, ignore, r + 1);
+        const __m256i m2 = matches_avx2(data + offset + 64, pattern, ignore, r + 2);
+        const __m256i m3 = matches_avx2(data + offset + 96, pattern, ignore, r + 3);
+        const __m256i all = _mm256_and_si256(_mm256_and_si256(m0, m1), _mm256_and_si256(m2, m3));
+        if(uint32_t(_mm256_movemask_epi8(all)) != 0xffffffffu) {
+            const __m256i parts[4] = {m0, m1, m2, m3};
+            for(size_t i = 0; i < 4; ++i) {
+                const uint32_t mismatched = ~uint32_t(_mm256_movemask_epi8(parts[i]));
+                if(mismatched != 0) {
+                    return (offset + i * 32 + bsf(mismatched)) / stride;
+                }
+            }
+        }
+        r += step;
+        r -= r >= registers ? registers : 0;
+    }
+    for(; offset + 32 <= bytes; offset += 32) {
+        const uint32_t mismatched = ~uint32_t(_mm256_movemask_epi8(matches_avx2(data + offset, pattern, ignore, r)));
+        if(mismatched != 0) {
+            return (offset + bsf(mismatched)) / stride;
+        }
+        r = r + 1 == registers ? 0 : r + 1;
+    }
+    return mismatch_elements(data, elements_before(offset, count, stride, width), count, stride, value, width);
+}
+
+
+inline
+size_t count_scalar(const uint8_t* data, size_t count, size_t stride, const uint8_t* value, size_t width) {
+
+    if(count == 0 || 8 % stride != 0) {
+        return count_elements(data, 0, count, stride, value, width);
+    }
+
+    uint8_t pattern_bytes[8 * 4];
+    uint8_t ignore_bytes[8 * 4];
+    build_pattern(pattern_bytes, ignore_bytes, 1, 8, value, width, stride);
+    uint64_t pattern;
+    uint64_t care;
+    std::memcpy(&pattern, pattern_bytes, 8);
+    std::memcpy(&care, ignore_bytes, 8);
+    care = ~care;
+
+    // A byte's high bit is set when it's all zero (the usual has-zero-byte trick, exact here
+    // as it's applied to each byte on its own rather than summed across them)
+    const uint64_t low = 0x7f7f7f7f7f7f7f7full;
+    uint64_t starts = 0;
+    for(size_t i = 0; i < 8; i += stride) {
+        starts |= uint64_t(0x80) << (i * 8);
+    }
+
+    const size_t bytes = (count - 1) * stride + width;
+    size_t equal = 0;
+    size_t offset = 0;
+    for(; offset + 8 <= bytes; offset += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + offset, 8);
+        const uint64_t diff = (word ^ pattern) & care;
+        uint64_t zero = ~(((diff & low) + low) | diff | low);
+        // Fold each element's bytes into its first byte
+        for(size_t shift = 8; shift < stride * 8; shift *= 2) {
+            zero &= zero >> shift;
+        }
+        // One bit per byte at most, so summing the bytes with a multiply counts them
+        equal += size_t((((zero & starts) >> 7) * 0x0101010101010101ull) >> 56);
+    }
+    return equal + count_elements(data, elements_before(offset, count, stride, width), count, stride, value, width);
+}
+
+
+inline
+size_t count_sse2(const uint8_t* data, size_t count, size_t stride, const uint8_t* value, size_t width) {
+
+    if(count == 0 || 16 % stride != 0) {
+        return count_elements(data, 0, count, stride, value, width);
+    }
+
+    alignas(16) uint8_t pattern_bytes[16 * 4];
+    alignas(16) uint8_t ignore_bytes[16 * 4];
+    build_pattern(pattern_bytes, ignore_bytes, 1, 16, value, width, stride);
+    const __m128i pattern = _mm_load_si128((const __m128i*)pattern_bytes);
+    const __m128i ignore = _mm_load_si128((const __m128i*)ignore_bytes);
+    const uint64_t starts = element_starts(stride, 64);
+
+    auto matched = [&](size_t offset) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(data + offset));
+        return uint64_t(unsigned(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, pattern), ignore))));
+    };
+
+    // Without popcnt it's a dozen instructions, so once per four registers
+    const size_t bytes = (count - 1) * stride + width;
+    size_t equal = 0;
+    size_t offset = 0;
+    for(; offset + 64 <= bytes; offset += 64) {
+        const uint64_t mask = matched(offset) | matched(offset + 16) << 16 | matched(offset + 32) << 32 | matched(offset + 48) << 48;
+        equal += size_t(std::popcount(fold_elements(mask, stride) & starts));
+    }
+    for(; offset + 16 <= bytes; offset += 16) {
+        equal += size_t(std::popcount(fold_elements(matched(offset), stride) & starts));
+    }
+    return equal + count_elements(data, elements_before(offset, count, stride, width), count, stride, value, width);
+}
+
+
+MULTIVERSION_TARGET_AVX2 inline
+size_t count_avx2(const uint8_t* data, size_t count, size_t stride, const uint8_t* value, size_t width) {
+
+    if(count == 0 || 32 % stride != 0) {
+        return count_elements(data, 0, count, stride, value, width);
+    }
+
+    alignas(32) uint8_t pattern_bytes[32 * 4];
+    alignas(32) uint8_t ignore_bytes[32 * 4];
+    build_pattern(pattern_bytes, ignore_bytes, 1, 32, value, width, stride);
+    const __m256i pattern = _mm256_load_si256((const __m256i*)pattern_bytes);
+    const __m256i ignore = _mm256_load_si256((const __m256i*)ignore_bytes);
+    const uint32_t starts = uint32_t(element_starts(stride, 32));
+
+    const size_t bytes = (count - 1) * stride + width;
+    size_t equal = 0;
+    size_t offset = 0;
+    for(; offset + 32 <= bytes; offset += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(data + offset));
+        const __m256i matched = _mm256_or_si256(_mm256_cmpeq_epi8(v, pattern), ignore);
+        const uint32_t mask = uint32_t(fold_elements(uint32_t(_mm256_movemask_epi8(matched)), stride));
+        equal += size_t(std::popcount(mask & starts));
+    }
+    return equal + count_elements(data, elements_before(offset, count, stride, width), count, stride, value, width);
+}
+
+} // namespace detail::all_the_same
+
+
+inline constinit multiversion<size_t(const uint8_t*, size_t, size_t, const uint8_t*, size_t)> find_first_mismatch_variants {
+    {isa::scalar, detail::all_the_same::mismatch_scalar},
+    {isa::sse2, detail::all_the_same::mismatch_sse2},
+    {isa::avx2, detail::all_the_same::mismatch_avx2},
+};
+
+inline constinit multiversion<size_t(const uint8_t*, size_t, size_t, const uint8_t*, size_t)> count_equal_variants {
+    {isa::scalar, detail::all_the_same::count_scalar},
+    {isa::sse2, detail::all_the_same::count_sse2},
+    {isa::avx2, detail::all_the_same::count_avx2},
+};
+
+
+// Index of the first element (first + i * stride bytes) bitwise different to value, count if
+// there isn't one. stride >= sizeof(T)
+template<typename T>
+inline size_t find_first_mismatch_strided(const void* first, size_t count, size_t stride, const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>, "Elements are compared bitwise");
+    return find_first_mismatch_variants((const uint8_t*)first, count, stride, (const uint8_t*)&value, sizeof(T));
+}
+
+template<typename T>
+inline bool all_equal_to_strided(const void* first, size_t count, size_t stride, const T& value) {
+    return find_first_mismatch_strided(first, count, stride, value) == count;
+}
+
+template<typename T>
+inline bool all_the_same_strided(const T* first, size_t count, size_t stride) {
+    if(count < 2) {
+        return true;
+    }
+    static_assert(std::is_trivially_copyable_v<T>, "Elements are compared bitwise");
+    // The bytes are copied, first may not be aligned for a T (or T default constructible)
+    uint8_t value[sizeof(T)];
+    std::memcpy(value, first, sizeof(T));
+    const size_t rest = count - 1;
+    return find_first_mismatch_variants((const uint8_t*)first + stride, rest, stride, value, sizeof(T)) == rest;
+}
+
+template<typename T>
+inline size_t count_equal_strided(const void* first, size_t count, size_t stride, const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>, "Elements are compared bitwise");
+    return count_equal_variants((const uint8_t*)first, count, stride, (const uint8_t*)&value, sizeof(T));
+}
+
+
+template<typename T>
+inline size_t find_first_mismatch(const T* data, size_t count, const T& value) {
+    return find_first_mismatch_strided(data, count, sizeof(T), value);
+}
+
+template<typename T>
+inline bool all_equal_to(const T* data, size_t count, const T& value) {
+    return find_first_mismatch_strided(data, count, sizeof(T), value) == count;
+}
+
+template<typename T>
+inline bool all_the_same(const T* data, size_t count) {
+    return all_the_same_strided(data, count, sizeof(T));
+}
+
+template<typename T>
+inline size_t count_equal(const T* data, size_t count, const T& value) {
+    return count_equal_strided(data, count, sizeof(T), value);
+}
@@ -12,87 +12,125 @@
     #error "Only really intended for x64 gcc/clang/msc"
 #endif
 
+#include "../generic/runtime_function_loading.h"
 
-inline
-void ascii_tolower_inplace(char* data, const uint32_t count) {
-
-    uint32_t i = 0;
 
-    // Do one xmm register at a time
-    if(count >= 16) {
+// Lowercases A-Z, leaving every other byte alone. The widest variant the cpu supports
+// (scalar / SSE2 / AVX2 / AVX-512BW) is picked at runtime, see runtime_function_loading.h,
+// ascii_tolower_variants can be used to test each of them.
 
-        // There is no cmple or cmpge intrinsic for epi8
-        const __m128i A = _mm_set1_epi8('A' - 1);
-        const __m128i Z = _mm_set1_epi8('Z' + 1);
-        const __m128i space = _mm_set1_epi8(' ');
 
-        for(; i < (count & (0u - 16u)); i+= 16) {
+namespace detail::ascii_tolower {
 
-            __m128i block = _mm_lddqu_si128((__m128i*)&data[i]);
-            __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(block, A), _mm_cmplt_epi8(block, Z));
-
-            const bool any_capitals = _mm_testc_si128(in_range, in_range);
-
-            if(any_capitals) {
-                __m128i lowered = _mm_add_epi8(block, space);
-                __m128i result = _mm_blendv_epi8(block, lowered, in_range);
-                _mm_storeu_si128((__m128i*)&data[i], result);
-            }
-        }
-    }
+inline
+void tail(char* dst, const char* src, uint32_t i, const uint32_t count) {
 
-    // Do the remaining
     for(; i < count ; ++i) {
-        char c = data[i];
-        if( c >= 'A' && c <= 'Z') {
-            data[i] = c + ' ';
+        char c = src[i];
+        if( (c >= 'A') && (c <= 'Z') ) {
+            c = c + ' ';
         }
+        dst[i] = c;
     }
 }
 
 
 inline
-void ascii_tolower(char* dst, const char* src, const uint32_t count) {
+void scalar(char* dst, const char* src, const uint32_t count) {
 
-    if(dst == src) {
-        ascii_tolower_inplace(dst, count);
-        return;
-    }
+    tail(dst, src, 0, count);
+}
+
+
+MULTIVERSION_TARGET_SSE2 inline
+void sse2(char* dst, const char* src, const uint32_t count) {
 
     uint32_t i = 0;
 
-    // Do one xmm register at a time
-    if(count >= 16) {
+    // There is no cmple or cmpge intrinsic for epi8
+    const __m128i A = _mm_set1_epi8('A' - 1);
+    const __m128i Z = _mm_set1_epi8('Z' + 1);
+    const __m128i space = _mm_set1_epi8(' ');
 
-        // There is no cmple or cmpge intrinsic for epi8
-        const __m128i A = _mm_set1_epi8('A' - 1);
-        const __m128i Z = _mm_set1_epi8('Z' + 1);
-        const __m128i space = _mm_set1_epi8(' ');
+    for(; i < (count & (0u - 16u)); i+= 16) {
 
-        for(; i < (count & (0u - 16u)); i+= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)&src[i]);
+        __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(block, A), _mm_cmplt_epi8(block, Z));
+
+        // In place, blocks without any capitals don't need writing back
+        if(_mm_movemask_epi8(in_range) || dst != src) {
+            _mm_storeu_si128((__m128i*)&dst[i], _mm_add_epi8(block, _mm_and_si128(in_range, space)));
+        }
+    }
+
+    tail(dst, src, i, count);
+}
+
+
+MULTIVERSION_TARGET_AVX2 inline
+void avx2(char* dst, const char* src, const uint32_t count) {
+
+    uint32_t i = 0;
 
-            __m128i block = _mm_lddqu_si128((__m128i*)&src[i]);
-            __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(block, A), _mm_cmplt_epi8(block, Z));
-            
-            const bool any_capitals = _mm_testc_si128(in_range, in_range);
+    const __m256i A = _mm256_set1_epi8('A' - 1);
+    const __m256i Z = _mm256_set1_epi8('Z' + 1);
+    const __m256i space = _mm256_set1_epi8(' ');
 
-            if(any_capitals) {
-                __m128i lowered = _mm_add_epi8(block, space);
-                block = _mm_blendv_epi8(block, lowered, in_range);
-            }
+    for(; i < (count & (0u - 32u)); i+= 32) {
 
-            _mm_storeu_si128((__m128i*)&dst[i], block);
+        __m256i block = _mm256_loadu_si256((const __m256i*)&src[i]);
+        __m256i in_range = _mm256_and_si256(_mm256_cmpgt_epi8(block, A), _mm256_cmpgt_epi8(Z, block));
 
+        if(_mm256_movemask_epi8(in_range) || dst != src) {
+            _mm256_storeu_si256((__m256i*)&dst[i], _mm256_add_epi8(block, _mm256_and_si256(in_range, space)));
         }
     }
 
-    // Do the remaining
-    for(; i < count ; ++i) {
-        char c = src[i];
-        if( (c >= 'A') && (c <= 'Z') ) {
-            c = c + ' ';
+    tail(dst, src, i, count);
+}
+
+
+MULTIVERSION_TARGET_AVX512 inline
+void avx512(char* dst, const char* src, const uint32_t count) {
+
+    // c - 'A' < 26 as unsigned is A-Z, and masked loads / stores take care of the tail
+    const __m512i A = _mm512_set1_epi8('A');
+    const __m512i letters = _mm512_set1_epi8(26);
+    const __m512i space = _mm512_set1_epi8(' ');
+
+    for(uint32_t i = 0; i < count; i += 64) {
+
+        const uint32_t remaining = count - i;
+        const __mmask64 valid = remaining >= 64 ? ~__mmask64(0) : (__mmask64(1) << remaining) - 1;
+        __m512i block = _mm512_maskz_loadu_epi8(valid, &src[i]);
+        __mmask64 in_range = _mm512_cmplt_epu8_mask(_mm512_sub_epi8(block, A), letters);
+
+        if(in_range || dst != src) {
+            _mm512_mask_storeu_epi8(&dst[i], valid, _mm512_mask_add_epi8(block, in_range, block, space));
         }
-        dst[i] = c;
     }
+}
+
+} // namespace detail::ascii_tolower
+
+
+inline constinit multiversion<void(char*, const char*, uint32_t)> ascii_tolower_variants {
+    {isa::scalar, detail::ascii_tolower::scalar},
+    {isa::sse2, detail::ascii_tolower::sse2},
+    {isa::avx2, detail::ascii_tolower::avx2},
+    {isa::avx512, detail::ascii_tolower::avx512},
+};
+
+
+inline
+void ascii_tolower_inplace(char* data, const uint32_t count) {
+
+    ascii_tolower_variants(data, data, count);
+}
+
+
+inline
+void ascii_tolower(char* dst, const char* src, const uint32_t count) {
 
+    ascii_tolower_variants(dst, src, count);
 }
@@ -0,0 +1,320 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+    #include <intrin.h>
+
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <x86intrin.h>
+
+#else
+    #error "Only really intended for x64 gcc/clang/msc"
+#endif
+
+#include "../generic/runtime_function_loading.h"
+
+
+// Merge sort for uint32_t keys (and uint32_t key + uint32_t value pairs), with whole
+// registers sorted then merged by bitonic networks, so no branch depends on the data other
+// than which run the next register of input comes from.
+//
+// bitonic_sort(keys, count);
+// bitonic_sort_pairs(keys, values, count);     // stable
+//
+// Keys sort as 8 lanes of an AVX2 register. Pairs are packed as key << 32 | original index
+// and sorted as 4 x uint64_t lanes, the index making every element unique (so stable),
+// after which values are gathered by it. Without AVX2 they fall back to std::sort of the
+// same, see runtime_function_loading.h.
+//
+// Random keys, 1 thread, millions of keys per second (GCC 12, -O2, AVX2):
+//
+//                              1K          64K         1M          10M
+//    std::sort  uint32_t       ~59         ~10         ~8          ~7
+//    bitonic_sort              ~125        ~61         ~39         ~32
+//    radix_sort                ~65         ~57         ~26         ~27
+//    std::stable_sort pairs    ~32         ~8          ~6          ~5
+//    bitonic_sort_pairs        ~24         ~14         ~8          ~7
+//    radix_sort_pairs          ~51         ~40         ~15         ~17
+//
+// So this for keys alone, generic/radix_sort.h for pairs (the 64 bit lanes halve the width,
+// and their compares need emulating) or when the work should be split across threads.
+//
+
+
+namespace detail::bitonic_sort {
+
+// 8 x uint32_t lanes
+struct u32x8 {
+
+    using T = uint32_t;
+    static constexpr size_t lanes = 8;
+    static constexpr T max_value = UINT32_MAX;
+
+    MULTIVERSION_TARGET_AVX2 static inline __m256i load(const T* p) { return _mm256_loadu_si256((const __m256i*)p); }
+    MULTIVERSION_TARGET_AVX2 static inline void store(T* p, __m256i v) { _mm256_storeu_si256((__m256i*)p, v); }
+    MULTIVERSION_TARGET_AVX2 static inline __m256i min(__m256i a, __m256i b) { return _mm256_min_epu32(a, b); }
+    MULTIVERSION_TARGET_AVX2 static inline __m256i max(__m256i a, __m256i b) { return _mm256_max_epu32(a, b); }
+
+    MULTIVERSION_TARGET_AVX2 static inline __m256i reverse(__m256i v) {
+        return _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    }
+
+    // Lanes of a bitonic sequence, compared at distance 4, 2 then 1
+    MULTIVERSION_TARGET_AVX2 static inline __m256i clean(__m256i v) {
+        __m256i partner = _mm256_permute2x128_si256(v, v, 1);
+        v = _mm256_blend_epi32(min(v, partner), max(v, partner), 0xf0);
+        partner = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+        v = _mm256_blend_epi32(min(v, partner), max(v, partner), 0xcc);
+        partner = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+        return _mm256_blend_epi32(min(v, partner), max(v, partner), 0xaa);
+    }
+
+    // Bitonic sort, pairs, then merging into 4s, then 8
+    MULTIVERSION_TARGET_AVX2 static inline __m256i sort(__m256i v) {
+        __m256i partner = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+        v = _mm256_blend_epi32(min(v, partner), max(v, partner), 0x66);     // Alternating directions
+
+        partner = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+        v = _mm256_blend_epi32(min(v, partner), max(v, partner), 0x3c);
+        partner = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+        v = _mm256_blend_epi32(min(v, partner), max(v, partner), 0x5a);     // Ascending 4, descending 4
+
+        return clean(v);
+    }
+};
+
+
+// 4 x uint64_t lanes, AVX2 only has a signed 64 bit compare, so the sign bits get flipped
+struct u64x4 {
+
+    using T = uint64_t;
+    static constexpr size_t lanes = 4;
+    static constexpr T max_value = UINT64_MAX;
+
+    MULTIVERSION_TARGET_AVX2 static inline __m256i load(const T* p) { return _mm256_loadu_si256((const __m256i*)p); }
+    MULTIVERSION_TARGET_AVX2 static inline void store(T* p, __m256i v) { _mm256_storeu_si256((__m256i*)p, v); }
+
+    MULTIVERSION_TARGET_AVX2 static inline __m256i greater(__m256i a, __m256i b) {
+        const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+        return _mm256_cmpgt_epi64(_mm256_xor_si256(a, sign), _mm256_xor_si256(b, sign));
+    }
+    MULTIVERSION_TARGET_AVX2 static inline __m256i min(__m256i a, __m256i b) { return _mm256_blendv_epi8(a, b, greater(a, b)); }
+    MULTIVERSION_TARGET_AVX2 static inline __m256i max(__m256i a, __m256i b) { return _mm256_blendv_epi8(b, a, greater(a, b)); }
+
+    MULTIVERSION_TARGET_AVX2 static inline __m256i reverse(__m256i v) {
+        return _mm256_permute4x64_epi64(v, _MM_SHUFFLE(0, 1, 2, 3));
+    }
+
+    MULTIVERSION_TARGET_AVX2 static inline __m256i clean(__m256i v) {
+        __m256i partner = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 0, 3, 2));
+        v = _mm256_blend_epi32(min(v, partner), max(v, partner), 0xf0);
+        partner = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+        return _mm256_blend_epi32(min(v, partner), max(v, partner), 0xcc);
+    }
+
+    MULTIVERSION_TARGET_AVX2 static inline __m256i sort(__m256i v) {
+        __m256i partner = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+        v = _mm256_blend_epi32(min(v, partner), max(v, partner), 0x3c);     // Ascending pair, descending pair
+        return clean(v);
+    }
+};
+
+
+// a and b sorted, afterwards a holds the lowest lanes of both, b the highest, both sorted
+template<typename V>
+MULTIVERSION_TARGET_AVX2 inline void merge(__m256i& a, __m256i& b) {
+    const __m256i reversed = V::reverse(b);
+    const __m256i lo = V::min(a, reversed);
+    const __m256i hi = V::max(a, reversed);
+    a = V::clean(lo);
+    b = V::clean(hi);
+}
+
+
+// Run lengths are multiples of the lane count
+template<typename V, typename T = typename V::T>
+MULTIVERSION_TARGET_AVX2 inline void merge_runs(const T* a, size_t a_count, const T* b, size_t b_count, T* out) {
+
+    constexpr size_t L = V::lanes;
+
+    __m256i low = V::load(a);
+    __m256i high = V::load(b);
+    size_t ia = L;
+    size_t ib = L;
+
+    merge<V>(low, high);
+    V::store(out, low);
+    out += L;
+
+    // Whichever run's next value is smaller can hold values below the current high
+    while(ia < a_count && ib < b_count) {
+        if(a[ia] < b[ib]) {
+            low = V::load(a + ia);
+            ia += L;
+        } else {
+            low = V::load(b + ib);
+            ib += L;
+        }
+        merge<V>(low, high);
+        V::store(out, low);
+        out += L;
+    }
+
+    for(; ia < a_count; ia += L, out += L) {
+        low = V::load(a + ia);
+        merge<V>(low, high);
+        V::store(out, low);
+    }
+    for(; ib < b_count; ib += L, out += L) {
+        low = V::load(b + ib);
+        merge<V>(low, high);
+        V::store(out, low);
+    }
+
+    V::store(out, high);
+}
+
+
+// count is a multiple of the lane count, scratch is as big, the result ends up in data
+template<typename V, typename T = typename V::T>
+MULTIVERSION_TARGET_AVX2 inline void merge_sort(T* data, T* scratch, const size_t count) {
+
+    constexpr size_t L = V::lanes;
+
+    for(size_t i = 0; i < count; i += L) {
+        V::store(data + i, V::sort(V::load(data + i)));
+    }
+
+    T* src = data;
+    T* dst = scratch;
+    for(size_t width = L; width < count; width *= 2) {
+        for(size_t start = 0; start < count; start += 2 * width) {
+            const size_t middle = std::min(start + width, count);
+            const size_t end = std::min(start + 2 * width, count);
+            if(middle == end) {
+                std::memcpy(dst + start, src + start, (end - start) * sizeof(T));
+            } else {
+                merge_runs<V>(src + start, middle - start, src + middle, end - middle, dst + start);
+            }
+        }
+        std::swap(src, dst);
+    }
+
+    if(src != data) {
+        std::memcpy(data, src, count * sizeof(T));
+    }
+}
+
+
+inline size_t padded(size_t count, size_t lanes) {
+    return (count + lanes - 1) / lanes * lanes;
+}
+
+
+inline
+void scalar(uint32_t* keys, const size_t count) {
+
+    std::sort(keys, keys + count);
+}
+
+
+MULTIVERSION_TARGET_AVX2 inline
+void avx2(uint32_t* keys, const size_t count) {
+
+    constexpr size_t L = u32x8::lanes;
+
+    // Whole registers sort in place, otherwise padded with the max value, which sorts to the end
+    if(count % L == 0) {
+        std::unique_ptr<uint32_t[]> scratch(new uint32_t[count]);
+        merge_sort<u32x8>(keys, scratch.get(), count);
+        return;
+    }
+
+    const size_t size = padded(count, L);
+    std::unique_ptr<uint32_t[]> buffer(new uint32_t[size * 2]);
+    std::memcpy(buffer.get(), keys, count * sizeof(uint32_t));
+    std::fill(buffer.get() + count, buffer.get() + size, u32x8::max_value);
+
+    merge_sort<u32x8>(buffer.get(), buffer.get() + size, size);
+    std::memcpy(keys, buffer.get(), count * sizeof(uint32_t));
+}
+
+
+inline
+void pairs_scalar(uint32_t* keys, uint32_t* values, const size_t count) {
+
+    std::unique_ptr<uint64_t[]> packed(new uint64_t[count]);
+    for(size_t i = 0; i < count; ++i) {
+        packed[i] = (uint64_t(keys[i]) << 32) | uint32_t(i);
+    }
+    std::sort(packed.get(), packed.get() + count);
+
+    std::unique_ptr<uint32_t[]> original(new uint32_t[count]);
+    std::memcpy(original.get(), values, count * sizeof(uint32_t));
+    for(size_t i = 0; i < count; ++i) {
+        keys[i] = uint32_t(packed[i] >> 32);
+        values[i] = original[uint32_t(packed[i])];
+    }
+}
+
+
+MULTIVERSION_TARGET_AVX2 inline
+void pairs_avx2(uint32_t* keys, uint32_t* values, const size_t count) {
+
+    constexpr size_t L = u64x4::lanes;
+    const size_t size = padded(count, L);
+
+    std::unique_ptr<uint64_t[]> buffer(new uint64_t[size * 2]);
+    uint64_t* packed = buffer.get();
+    for(size_t i = 0; i < count; ++i) {
+        packed[i] = (uint64_t(keys[i]) << 32) | uint32_t(i);
+    }
+    std::fill(packed + count, packed + size, u64x4::max_value);
+
+    merge_sort<u64x4>(packed, packed + size, size);
+
+    // The scratch half is free again, for the original values
+    uint32_t* original = reinterpret_cast<uint32_t*>(packed + size);
+    std::memcpy(original, values, count * sizeof(uint32_t));
+    for(size_t i = 0; i < count; ++i) {
+        keys[i] = uint32_t(packed[i] >> 32);
+        values[i] = original[uint32_t(packed[i])];
+    }
+}
+
+} // namespace detail::bitonic_sort
+
+
+inline constinit multiversion<void(uint32_t*, size_t)> bitonic_sort_variants {
+    {isa::scalar, detail::bitonic_sort::scalar},
+    {isa::avx2, detail::bitonic_sort::avx2},
+};
+
+inline constinit multiversion<void(uint32_t*, uint32_t*, size_t)> bitonic_sort_pairs_variants {
+    {isa::scalar, detail::bitonic_sort::pairs_scalar},
+    {isa::avx2, detail::bitonic_sort::pairs_avx2},
+};
+
+
+inline
+void bitonic_sort(uint32_t* keys, const size_t count) {
+
+    if(count > 1) {
+        bitonic_sort_variants(keys, count);
+    }
+}
+
+
+// Stable, count has to fit in 32 bits (the index packed next to each key)
+inline
+void bitonic_sort_pairs(uint32_t* keys, uint32_t* values, const size_t count) {
+
+    if(count > 1) {
+        bitonic_sort_pairs_variants(keys, values, count);
+    }
+}
@@ -0,0 +1,738 @@
+#pragma once
+
+// Array versions of generic/fmath.h and generic/int_to_float.h, along with a few fast
+// approximations.
+//
+// Each array function takes (inputs..., output, count), does 8 elements at a time with
+// AVX2, 4 at a time with SSE4.1 and uses the scalar versions for whatever is left over.
+// Which of those the cpu supports is picked at runtime, see runtime_function_loading.h,
+// detail::fmath_simd::transform_variants<Kernel, Out, Ins...> can be used to test each.
+//
+//  float   p[N];
+//  int32_t e[N];
+//  fPow2(e, p, N);                 // p[i] = fPow2(e[i])
+//  u8ToF32(bytes, p, N);           // p[i] = u8ToF32(bytes[i])
+//  u8Lerp(a, b, t, out, N);        // out[i] = u8Lerp(a[i], b[i], t[i])
+//  next2n(p, 3, p, N);             // p[i] = next2n(p[i], 3)
+//
+// Fast approximations (max errors measured exhaustively over every float in range):
+//
+//  fastLog2(x)   x > 0 (normals only)   abs error <= 6.0e-6   (mostly from rounding e + log2(m) for large |e|)
+//  fastExp2(x)   x in [-126, 128)       rel error <= 1.7e-7
+//  fastRcp(x)    normals                rel error <= 1.8e-7   (rcpps + 1x newton step)
+//  fastRsqrt(x)  x > 0 (normals only)   rel error <= 2.9e-7   (rsqrtps + 1x newton step)
+//
+// Compared against a loop over libm (ns per element, 4096 elements, AVX2, gcc -O2 -march=native):
+//
+//  std::log2           4.18        fastLog2        0.29
+//  std::exp2           3.93        fastExp2        0.34
+//  1.0f / x            1.29        fastRcp         0.12
+//  1.0f / std::sqrt    2.51        fastRsqrt       0.14
+//
+// With 16M elements everything (other than libm log2/exp2) ends up memory bound at ~1.6ns.
+//
+// template<class F> double bench(F f, size_t n)
+// {
+//     f();
+//     auto t = std::chrono::steady_clock::now();
+//     for(int r=0; r<20; ++r) { f(); }
+//     return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t).count() / 20 / n;
+// }
+//
+// int main()
+// {
+//     const size_t n = 4096;
+//     std::vector<float> a(n), o(n);
+//     std::mt19937 g(1);
+//     for(float& x : a) { x = std::uniform_real_distribution<float>(0.01f, 100.0f)(g); }
+//     float* A = a.data();
+//     float* O = o.data();
+//     printf("std::log2 %.2f\n", bench([&]{ for(size_t i=0; i<n; ++i) { O[i] = std::log2(A[i]); } asm volatile(""::"r"(O):"memory"); }, n));
+//     printf("fastLog2  %.2f\n", bench([&]{ fastLog2(A, O, n); asm volatile(""::"r"(O):"memory"); }, n));
+//     ...
+// }
+//
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "../generic/fmath.h"
+#include "../generic/int_to_float.h"
+#include "../generic/runtime_function_loading.h"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+    #include <intrin.h>
+
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <x86intrin.h>
+
+#else
+    #error "Only really intended for x64 gcc/clang/msc"
+#endif
+
+
+namespace detail
+{
+namespace fmath_simd
+{
+
+// Minimax coefficients
+// log2(1 + t) = t * (c0 + t * (c1 + ...)),  t in [0, 1)
+constexpr float LOG2_C0 =  1.44255313f;
+constexpr float LOG2_C1 = -0.718281757f;
+constexpr float LOG2_C2 =  0.458270063f;
+constexpr float LOG2_C3 = -0.279536644f;
+constexpr float LOG2_C4 =  0.12345012f;
+constexpr float LOG2_C5 = -0.0264569841f;
+
+// 2^t = 1 + t * (c0 + t * (c1 + ...)),  t in [0, 1)
+constexpr float EXP2_C0 = 0.693151312f;
+constexpr float EXP2_C1 = 0.240164444f;
+constexpr float EXP2_C2 = 0.0557999326f;
+constexpr float EXP2_C3 = 0.00901700537f;
+constexpr float EXP2_C4 = 0.0018671409f;
+
+} // namespace fmath_simd
+} // namespace detail
+
+
+FORCE_INLINE float fastLog2(float x)
+{
+    using namespace detail::fmath_simd;
+    const uint32_t bits = std::bit_cast<uint32_t>(x);
+    const float e = float(int32_t(bits >> 23) - 127);
+    const float t = std::bit_cast<float>((bits & 0x7fffffu) | 0x3f800000u) - 1.0f;
+    float p = LOG2_C5;
+    p = p * t + LOG2_C4;
+    p = p * t + LOG2_C3;
+    p = p * t + LOG2_C2;
+    p = p * t + LOG2_C1;
+    p = p * t + LOG2_C0;
+    return p * t + e;
+}
+
+
+FORCE_INLINE float fastExp2(float x)
+{
+    using namespace detail::fmath_simd;
+    x = x < -126.0f ? -126.0f : x;
+    x = x > 127.99999f ? 127.99999f : x;
+    const float fi = std::floor(x);
+    const float t = x - fi;
+    float p = EXP2_C4;
+    p = p * t + EXP2_C3;
+    p = p * t + EXP2_C2;
+    p = p * t + EXP2_C1;
+    p = p * t + EXP2_C0;
+    p = p * t + 1.0f;
+    return std::bit_cast<float>(std::bit_cast<int32_t>(p) + (int32_t(fi) << 23));
+}
+
+
+FORCE_INLINE float fastRcp(float x)
+{
+    const float r = _mm_cvtss_f32(_mm_rcp_ss(_mm_set_ss(x)));
+    return r * (2.0f - x * r);
+}
+
+
+FORCE_INLINE float fastRsqrt(float x)
+{
+    const float r = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+    return r * (1.5f - 0.5f * x * r * r);
+}
+
+
+namespace detail
+{
+namespace fmath_simd
+{
+
+// Thin wrappers, so each kernel only needs writing once. They carry the target, so they're
+// plain inline (gcc won't always_inline them into the target-less kernels), and get inlined
+// once the kernels are inlined into the transform_* variants. V8 wraps its vectors in structs
+// and the kernels take them by reference, as gcc otherwise warns about the target-less
+// kernels passing __m256 around (-Wpsabi).
+
+struct V4
+{
+    const static size_t width = 4;
+    using f = __m128;
+    using i = __m128i;
+
+    MULTIVERSION_TARGET_SSE41 static inline f set1(float x) { return _mm_set1_ps(x); }
+    MULTIVERSION_TARGET_SSE41 static inline i set1(int32_t x) { return _mm_set1_epi32(x); }
+    MULTIVERSION_TARGET_SSE41 static inline f asf(i x) { return _mm_castsi128_ps(x); }
+    MULTIVERSION_TARGET_SSE41 static inline i asi(f x) { return _mm_castps_si128(x); }
+    MULTIVERSION_TARGET_SSE41 static inline f add(f a, f b) { return _mm_add_ps(a, b); }
+    MULTIVERSION_TARGET_SSE41 static inline f sub(f a, f b) { return _mm_sub_ps(a, b); }
+    MULTIVERSION_TARGET_SSE41 static inline f mul(f a, f b) { return _mm_mul_ps(a, b); }
+    MULTIVERSION_TARGET_SSE41 static inline f min(f a, f b) { return _mm_min_ps(a, b); }
+    MULTIVERSION_TARGET_SSE41 static inline f max(f a, f b) { return _mm_max_ps(a, b); }
+    MULTIVERSION_TARGET_SSE41 static inline f floor(f a) { return _mm_floor_ps(a); }
+    MULTIVERSION_TARGET_SSE41 static inline f rcp(f a) { return _mm_rcp_ps(a); }
+    MULTIVERSION_TARGET_SSE41 static inline f rsqrt(f a) { return _mm_rsqrt_ps(a); }
+    MULTIVERSION_TARGET_SSE41 static inline i add(i a, i b) { return _mm_add_epi32(a, b); }
+    MULTIVERSION_TARGET_SSE41 static inline i sub(i a, i b) { return _mm_sub_epi32(a, b); }
+    MULTIVERSION_TARGET_SSE41 static inline i mul(i a, i b) { return _mm_mullo_epi32(a, b); }
+    MULTIVERSION_TARGET_SSE41 static inline i bitand_(i a, i b) { return _mm_and_si128(a, b); }
+    MULTIVERSION_TARGET_SSE41 static inline i bitor_(i a, i b) { return _mm_or_si128(a, b); }
+    MULTIVERSION_TARGET_SSE41 static inline i bitxor_(i a, i b) { return _mm_xor_si128(a, b); }
+    MULTIVERSION_TARGET_SSE41 static inline i sll(i a, int n) { return _mm_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+    MULTIVERSION_TARGET_SSE41 static inline i srl(i a, int n) { return _mm_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+    MULTIVERSION_TARGET_SSE41 static inline i sra(i a, int n) { return _mm_sra_epi32(a, _mm_cvtsi32_si128(n)); }
+    // NB: Per lane variable shifts are AVX2 only, so emulate them
+    MULTIVERSION_TARGET_SSE41 static inline i srlv(i a, i n)
+    {
+        alignas(16) uint32_t av[4], nv[4];
+        _mm_store_si128((__m128i*)av, a);
+        _mm_store_si128((__m128i*)nv, n);
+        for(int j=0; j<4; ++j) { av[j] >>= nv[j]; }
+        return _mm_load_si128((const __m128i*)av);
+    }
+    MULTIVERSION_TARGET_SSE41 static inline i cvtt(f a) { return _mm_cvttps_epi32(a); }
+    MULTIVERSION_TARGET_SSE41 static inline f cvt(i a) { return _mm_cvtepi32_ps(a); }
+
+    MULTIVERSION_TARGET_SSE41 static inline f load(const float* p) { return _mm_loadu_ps(p); }
+    MULTIVERSION_TARGET_SSE41 static inline i load(const int32_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+    MULTIVERSION_TARGET_SSE41 static inline i load(const uint32_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+    MULTIVERSION_TARGET_SSE41 static inline i load(const uint16_t* p) { return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)p)); }
+    MULTIVERSION_TARGET_SSE41 static inline i load(const uint8_t* p)
+    {
+        int32_t x;
+        std::memcpy(&x, p, sizeof(x));
+        return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(x));
+    }
+
+    MULTIVERSION_TARGET_SSE41 static inline void store(float* p, f x) { _mm_storeu_ps(p, x); }
+    MULTIVERSION_TARGET_SSE41 static inline void store(int32_t* p, i x) { _mm_storeu_si128((__m128i*)p, x); }
+    MULTIVERSION_TARGET_SSE41 static inline void store(uint32_t* p, i x) { _mm_storeu_si128((__m128i*)p, x); }
+    MULTIVERSION_TARGET_SSE41 static inline void store(uint8_t* p, i x)
+    {
+        // Truncate like a cast would, rather than saturating
+        x = _mm_and_si128(x, _mm_set1_epi32(0xff));
+        x = _mm_packus_epi32(x, x);
+        x = _mm_packus_epi16(x, x);
+        int32_t y = _mm_cvtsi128_si32(x);
+        std::memcpy(p, &y, sizeof(y));
+    }
+};
+
+
+struct V8
+{
+    const static size_t width = 8;
+    struct f { __m256 v; };
+    struct i { __m256i v; };
+
+    MULTIVERSION_TARGET_AVX2 static inline f set1(float x) { return {_mm256_set1_ps(x)}; }
+    MULTIVERSION_TARGET_AVX2 static inline i set1(int32_t x) { return {_mm256_set1_epi32(x)}; }
+    MULTIVERSION_TARGET_AVX2 static inline f asf(i x) { return {_mm256_castsi256_ps(x.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline i asi(f x) { return {_mm256_castps_si256(x.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline f add(f a, f b) { return {_mm256_add_ps(a.v, b.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline f sub(f a, f b) { return {_mm256_sub_ps(a.v, b.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline f mul(f a, f b) { return {_mm256_mul_ps(a.v, b.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline f min(f a, f b) { return {_mm256_min_ps(a.v, b.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline f max(f a, f b) { return {_mm256_max_ps(a.v, b.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline f floor(f a) { return {_mm256_floor_ps(a.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline f rcp(f a) { return {_mm256_rcp_ps(a.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline f rsqrt(f a) { return {_mm256_rsqrt_ps(a.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline i add(i a, i b) { return {_mm256_add_epi32(a.v, b.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline i sub(i a, i b) { return {_mm256_sub_epi32(a.v, b.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline i mul(i a, i b) { return {_mm256_mullo_epi32(a.v, b.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline i bitand_(i a, i b) { return {_mm256_and_si256(a.v, b.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline i bitor_(i a, i b) { return {_mm256_or_si256(a.v, b.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline i bitxor_(i a, i b) { return {_mm256_xor_si256(a.v, b.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline i sll(i a, int n) { return {_mm256_sll_epi32(a.v, _mm_cvtsi32_si128(n))}; }
+    MULTIVERSION_TARGET_AVX2 static inline i srl(i a, int n) { return {_mm256_srl_epi32(a.v, _mm_cvtsi32_si128(n))}; }
+    MULTIVERSION_TARGET_AVX2 static inline i sra(i a, int n) { return {_mm256_sra_epi32(a.v, _mm_cvtsi32_si128(n))}; }
+    MULTIVERSION_TARGET_AVX2 static inline i srlv(i a, i n) { return {_mm256_srlv_epi32(a.v, n.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline i cvtt(f a) { return {_mm256_cvttps_epi32(a.v)}; }
+    MULTIVERSION_TARGET_AVX2 static inline f cvt(i a) { return {_mm256_cvtepi32_ps(a.v)}; }
+
+    MULTIVERSION_TARGET_AVX2 static inline f load(const float* p) { return {_mm256_loadu_ps(p)}; }
+    MULTIVERSION_TARGET_AVX2 static inline i load(const int32_t* p) { return {_mm256_loadu_si256((const __m256i*)p)}; }
+    MULTIVERSION_TARGET_AVX2 static inline i load(const uint32_t* p) { return {_mm256_loadu_si256((const __m256i*)p)}; }
+    MULTIVERSION_TARGET_AVX2 static inline i load(const uint16_t* p) { return {_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p))}; }
+    MULTIVERSION_TARGET_AVX2 static inline i load(const uint8_t* p) { return {_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p))}; }
+
+    MULTIVERSION_TARGET_AVX2 static inline void store(float* p, f x) { _mm256_storeu_ps(p, x.v); }
+    MULTIVERSION_TARGET_AVX2 static inline void store(int32_t* p, i x) { _mm256_storeu_si256((__m256i*)p, x.v); }
+    MULTIVERSION_TARGET_AVX2 static inline void store(uint32_t* p, i x) { _mm256_storeu_si256((__m256i*)p, x.v); }
+    MULTIVERSION_TARGET_AVX2 static inline void store(uint8_t* p, i x)
+    {
+        __m256i z = _mm256_and_si256(x.v, _mm256_set1_epi32(0xff));
+        __m128i y = _mm_packus_epi32(_mm256_castsi256_si128(z), _mm256_extracti128_si256(z, 1));
+        y = _mm_packus_epi16(y, y);
+        _mm_storel_epi64((__m128i*)p, y);
+    }
+};
+
+
+struct RcpForPowersOf2
+{
+    template<typename V> static FORCE_INLINE typename V::f run(const typename V::f& x)
+    {
+        return V::asf(V::sub(V::set1(0x7f000000), V::asi(x)));
+    }
+    static FORCE_INLINE float scalar(float x) { return ::rcpForPowersOf2(&x); }
+};
+
+struct FPow2
+{
+    template<typename V> static FORCE_INLINE typename V::f run(const typename V::i& x)
+    {
+        return V::asf(V::add(V::set1(0x3f800000), V::sll(x, 23)));
+    }
+    static FORCE_INLINE float scalar(int32_t x) { return ::fPow2(x); }
+};
+
+struct FInvPow2
+{
+    template<typename V> static FORCE_INLINE typename V::f run(const typename V::i& x)
+    {
+        return V::asf(V::sub(V::set1(0x3f800000), V::sll(x, 23)));
+    }
+    static FORCE_INLINE float scalar(int32_t x) { return ::fInvPow2(x); }
+};
+
+struct U8ToF32
+{
+    template<typename V> static FORCE_INLINE typename V::f run(const typename V::i& y)
+    {
+        typename V::f x = V::asf(V::add(V::set1(0x3f800000), V::sll(y, 15)));
+        return V::sub(V::mul(V::set1(256.0f/255.0f), x), V::set1(256.0f/255.0f));
+    }
+    static FORCE_INLINE float scalar(uint8_t y) { return ::u8ToF32(y); }
+};
+
+struct F32ToU8
+{
+    template<typename V> static FORCE_INLINE typename V::i run(const typename V::f& x)
+    {
+        typename V::f y = V::add(V::mul(x, V::set1(255.5f/256.0f)), V::set1(1.000979431929481f));
+        return V::add(V::set1(-0x7f00), V::sra(V::asi(y), 15));
+    }
+    static FORCE_INLINE uint8_t scalar(float y) { return uint8_t(::f32ToU8(y)); }
+};
+
+struct F32ToU8v2
+{
+    template<typename V> static FORCE_INLINE typename V::i run(const typename V::f& x)
+    {
+        return V::asi(V::add(V::mul(V::asf(V::set1(0x37ff0000)), x), V::asf(V::set1(0x3f800000))));
+    }
+    static FORCE_INLINE uint8_t scalar(float x) { return ::f32ToU8v2(x); }
+};
+
+struct U16ToF32
+{
+    template<typename V> static FORCE_INLINE typename V::f run(const typename V::i& y)
+    {
+        typename V::f x = V::asf(V::add(V::set1(0x3f800000), V::sll(y, 7)));
+        return V::sub(V::mul(V::set1(65536.0f/65535.0f), x), V::set1(65536.0f/65535.0f));
+    }
+    static FORCE_INLINE float scalar(uint16_t y) { return ::u16ToF32(y); }
+};
+
+template<bool fast>
+struct U8Lerp
+{
+    template<typename V> static FORCE_INLINE typename V::i run(const typename V::i& a, const typename V::i& b, const typename V::f& x)
+    {
+        const int shift = fast ? 0 : 1;
+        typename V::f af = V::asf(V::add(V::set1(0x3f800000), V::sll(a, shift)));
+        typename V::f bf = V::asf(V::add(V::set1(0x3f800000), V::sll(b, shift)));
+        typename V::f cf = V::add(af, V::mul(V::sub(bf, af), x));
+        return V::srl(V::asi(cf), shift);
+    }
+    static FORCE_INLINE uint8_t scalar(uint8_t a, uint8_t b, float x)
+    {
+        return fast ? ::u8LerpFast(a, b, x) : ::u8Lerp(a, b, x);
+    }
+};
+
+template<int shift>
+struct LinearBounded
+{
+    template<typename V> static FORCE_INLINE typename V::f run(const typename V::i& x)
+    {
+        typename V::i y;
+        if constexpr(shift == 0) { y = V::bitand_(x, V::set1(0x7fffff)); }
+        else { y = V::sll(x, shift); }
+        return V::sub(V::asf(V::add(V::set1(0x3f800000), y)), V::set1(1.0f));
+    }
+    static FORCE_INLINE float scalar(uint32_t y)
+    {
+        if constexpr(shift == 15) { return ::u8LinearBounded(y); }
+        else if constexpr(shift == 7) { return ::u16LinearBounded(y); }
+        else { return ::randomBounded(y); }
+    }
+};
+
+struct FloorLog2
+{
+    template<typename V> static FORCE_INLINE typename V::f run(const typename V::f& x)
+    {
+        return V::asf(V::bitand_(V::asi(x), V::set1(int32_t(0xff800000))));
+    }
+    static FORCE_INLINE float scalar(float x) { return ::floorLog2(x); }
+};
+
+struct PcgHash
+{
+    template<typename V> static FORCE_INLINE typename V::i run(const typename V::i& a)
+    {
+        typename V::i state = V::add(V::mul(a, V::set1(int32_t(747796405u))), V::set1(int32_t(2891336453u)));
+        typename V::i word = V::mul(
+            V::bitxor_(V::srlv(state, V::add(V::srl(state, 28), V::set1(4))), state),
+            V::set1(int32_t(277803737u))
+        );
+        return V::bitxor_(V::srl(word, 22), word);
+    }
+    static FORCE_INLINE uint32_t scalar(uint32_t a) { return ::pcgHash(a); }
+};
+
+struct SimpleHash32
+{
+    template<typename V> static FORCE_INLINE typename V::i run(const typename V::i& x, const typename V::i& y, const typename V::i& z)
+    {
+        typename V::i hxy = V::mul(V::bitxor_(x, V::set1(int32_t(0xb543c3a6u))), V::bitxor_(y, V::set1(int32_t(0x526f94e2u))));
+        typename V::i hz0 = V::bitxor_(V::srl(hxy, 5), V::set1(int32_t(0x53c5ca59u)));
+        return V::mul(hz0, V::bitxor_(z, V::set1(int32_t(0x74743c1bu))));
+    }
+    static FORCE_INLINE uint32_t scalar(uint32_t x, uint32_t y, uint32_t z) { return ::simpleHash32(x, y, z); }
+};
+
+struct UintToFloat
+{
+    template<typename V> static FORCE_INLINE typename V::f run(const typename V::i& x)
+    {
+        return V::sub(V::asf(V::add(x, V::set1(0x4b000000))), V::asf(V::set1(0x4b000000)));
+    }
+    static FORCE_INLINE float scalar(uint32_t x) { return ::uint_to_float(x); }
+};
+
+struct FloatToUint
+{
+    template<typename V> static FORCE_INLINE typename V::i run(const typename V::f& x)
+    {
+        return V::bitand_(V::asi(V::add(x, V::asf(V::set1(0x4b000000)))), V::set1(0x7fffff));
+    }
+    static FORCE_INLINE uint32_t scalar(float x) { return ::float_to_uint(x); }
+};
+
+struct FastLog2
+{
+    template<typename V> static FORCE_INLINE typename V::f run(const typename V::f& x)
+    {
+        typename V::i bits = V::asi(x);
+        typename V::f e = V::cvt(V::sub(V::srl(bits, 23), V::set1(127)));
+        typename V::f t = V::sub(
+            V::asf(V::bitor_(V::bitand_(bits, V::set1(0x7fffff)), V::set1(0x3f800000))),
+            V::set1(1.0f)
+        );
+        typename V::f p = V::set1(LOG2_C5);
+        p = V::add(V::mul(p, t), V::set1(LOG2_C4));
+        p = V::add(V::mul(p, t), V::set1(LOG2_C3));
+        p = V::add(V::mul(p, t), V::set1(LOG2_C2));
+        p = V::add(V::mul(p, t), V::set1(LOG2_C1));
+        p = V::add(V::mul(p, t), V::set1(LOG2_C0));
+        return V::add(V::mul(p, t), e);
+    }
+    static FORCE_INLINE float scalar(float x) { return ::fastLog2(x); }
+};
+
+struct FastExp2
+{
+    template<typename V> static FORCE_INLINE typename V::f run(const typename V::f& x0)
+    {
+        typename V::f x = V::min(V::max(x0, V::set1(-126.0f)), V::set1(127.99999f));
+        typename V::f fi = V::floor(x);
+        typename V::f t = V::sub(x, fi);
+        typename V::f p = V::set1(EXP2_C4);
+        p = V::add(V::mul(p, t), V::set1(EXP2_C3));
+        p = V::add(V::mul(p, t), V::set1(EXP2_C2));
+        p = V::add(V::mul(p, t), V::set1(EXP2_C1));
+        p = V::add(V::mul(p, t), V::set1(EXP2_C0));
+        p = V::add(V::mul(p, t), V::set1(1.0f));
+        return V::asf(V::add(V::asi(p), V::sll(V::cvtt(fi), 23)));
+    }
+    static FORCE_INLINE float scalar(float x) { return ::fastExp2(x); }
+};
+
+struct FastRcp
+{
+    template<typename V> static FORCE_INLINE typename V::f run(const typename V::f& x)
+    {
+        typename V::f r = V::rcp(x);
+        return V::mul(r, V::sub(V::set1(2.0f), V::mul(x, r)));
+    }
+    static FORCE_INLINE float scalar(float x) { return ::fastRcp(x); }
+};
+
+struct FastRsqrt
+{
+    template<typename V> static FORCE_INLINE typename V::f run(const typename V::f& x)
+    {
+        typename V::f r = V::rsqrt(x);
+        return V::mul(r, V::sub(V::set1(1.5f), V::mul(V::mul(V::mul(V::set1(0.5f), x), r), r)));
+    }
+    static FORCE_INLINE float scalar(float x) { return ::fastRsqrt(x); }
+};
+
+// Runs Kernel::run<V>(inputs...) over the arrays, Kernel::scalar for what's left over.
+template<typename Kernel, typename Out, typename... Ins>
+inline void transform_scalar(Out* out, const size_t count, const Ins*... ins)
+{
+    for(size_t i=0; i<count; ++i)
+    {
+        out[i] = Kernel::scalar(ins[i]...);
+    }
+}
+
+template<typename Kernel, typename Out, typename... Ins>
+MULTIVERSION_TARGET_SSE41 inline void transform_sse41(Out* out, const size_t count, const Ins*... ins)
+{
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        V4::store(out + i, Kernel::template run<V4>(V4::load(ins + i)...));
+    }
+    for(; i < count; ++i)
+    {
+        out[i] = Kernel::scalar(ins[i]...);
+    }
+}
+
+template<typename Kernel, typename Out, typename... Ins>
+MULTIVERSION_TARGET_AVX2 inline void transform_avx2(Out* out, const size_t count, const Ins*... ins)
+{
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        V8::store(out + i, Kernel::template run<V8>(V8::load(ins + i)...));
+    }
+    for(; i + 4 <= count; i += 4)
+    {
+        V4::store(out + i, Kernel::template run<V4>(V4::load(ins + i)...));
+    }
+    for(; i < count; ++i)
+    {
+        out[i] = Kernel::scalar(ins[i]...);
+    }
+}
+
+template<typename Kernel, typename Out, typename... Ins>
+inline constinit multiversion<void(Out*, size_t, const Ins*...)> transform_variants {
+    {isa::scalar, transform_scalar<Kernel, Out, Ins...>},
+    {isa::sse41, transform_sse41<Kernel, Out, Ins...>},
+    {isa::avx2, transform_avx2<Kernel, Out, Ins...>},
+};
+
+template<typename Kernel, typename Out, typename... Ins>
+inline void transform(Out* out, const size_t count, const Ins*... ins)
+{
+    transform_variants<Kernel, Out, Ins...>(out, count, ins...);
+}
+
+
+inline void next2n_scalar(const float* x, const int n, float* out, const size_t count)
+{
+    for(size_t i=0; i<count; ++i)
+    {
+        out[i] = ::next2n(x[i], n);
+    }
+}
+
+MULTIVERSION_TARGET_SSE41 inline void next2n_sse41(const float* x, const int n, float* out, const size_t count)
+{
+    const float lower = std::bit_cast<float>(0x3f800000 - (n << 23));
+    const float raise = std::bit_cast<float>(0x3f800000 + (n << 23));
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128 y = _mm_floor_ps(_mm_mul_ps(_mm_loadu_ps(x + i), _mm_set1_ps(lower)));
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(y, _mm_set1_ps(raise)), _mm_set1_ps(raise)));
+    }
+    next2n_scalar(x + i, n, out + i, count - i);
+}
+
+MULTIVERSION_TARGET_AVX2 inline void next2n_avx2(const float* x, const int n, float* out, const size_t count)
+{
+    const float lower = std::bit_cast<float>(0x3f800000 - (n << 23));
+    const float raise = std::bit_cast<float>(0x3f800000 + (n << 23));
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256 y = _mm256_floor_ps(_mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_set1_ps(lower)));
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(y, _mm256_set1_ps(raise)), _mm256_set1_ps(raise)));
+    }
+    next2n_sse41(x + i, n, out + i, count - i);
+}
+
+
+inline void next2n_u32_sse2(const uint32_t* x, const uint32_t n, uint32_t* out, const size_t count)
+{
+    const uint32_t mask = (1 << n) - 1;
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i y = _mm_or_si128(_mm_loadu_si128((const __m128i*)(x + i)), _mm_set1_epi32(mask));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi32(y, _mm_set1_epi32(1)));
+    }
+    for(; i < count; ++i)
+    {
+        out[i] = ::next2n_u32(x[i], n);
+    }
+}
+
+MULTIVERSION_TARGET_AVX2 inline void next2n_u32_avx2(const uint32_t* x, const uint32_t n, uint32_t* out, const size_t count)
+{
+    const uint32_t mask = (1 << n) - 1;
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256i y = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(x + i)), _mm256_set1_epi32(mask));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi32(y, _mm256_set1_epi32(1)));
+    }
+    next2n_u32_sse2(x + i, n, out + i, count - i);
+}
+
+} // namespace fmath_simd
+} // namespace detail
+
+
+inline constinit multiversion<void(const float*, int, float*, size_t)> next2n_variants {
+    {isa::scalar, detail::fmath_simd::next2n_scalar},
+    {isa::sse41, detail::fmath_simd::next2n_sse41},
+    {isa::avx2, detail::fmath_simd::next2n_avx2},
+};
+
+inline constinit multiversion<void(const uint32_t*, uint32_t, uint32_t*, size_t)> next2n_u32_variants {
+    {isa::sse2, detail::fmath_simd::next2n_u32_sse2},
+    {isa::avx2, detail::fmath_simd::next2n_u32_avx2},
+};
+
+
+// Array versions
+
+inline void rcpForPowersOf2(const float* x, float* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::RcpForPowersOf2>(out, count, x);
+}
+
+inline void fPow2(const int32_t* x, float* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::FPow2>(out, count, x);
+}
+
+inline void fInvPow2(const int32_t* x, float* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::FInvPow2>(out, count, x);
+}
+
+inline void u8ToF32(const uint8_t* y, float* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::U8ToF32>(out, count, y);
+}
+
+inline void f32ToU8(const float* y, uint8_t* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::F32ToU8>(out, count, y);
+}
+
+inline void f32ToU8v2(const float* x, uint8_t* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::F32ToU8v2>(out, count, x);
+}
+
+inline void u16ToF32(const uint16_t* y, float* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::U16ToF32>(out, count, y);
+}
+
+inline void u8Lerp(const uint8_t* a, const uint8_t* b, const float* x, uint8_t* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::U8Lerp<false>>(out, count, a, b, x);
+}
+
+inline void u8LerpFast(const uint8_t* a, const uint8_t* b, const float* x, uint8_t* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::U8Lerp<true>>(out, count, a, b, x);
+}
+
+inline void u8LinearBounded(const uint8_t* y, float* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::LinearBounded<15>>(out, count, y);
+}
+
+inline void u16LinearBounded(const uint16_t* y, float* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::LinearBounded<7>>(out, count, y);
+}
+
+inline void randomBounded(const uint32_t* seed, float* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::LinearBounded<0>>(out, count, seed);
+}
+
+inline void floorLog2(const float* x, float* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::FloorLog2>(out, count, x);
+}
+
+inline void pcgHash(const uint32_t* a, uint32_t* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::PcgHash>(out, count, a);
+}
+
+inline void simpleHash32(const uint32_t* x, const uint32_t* y, const uint32_t* z, uint32_t* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::SimpleHash32>(out, count, x, y, z);
+}
+
+inline void uint_to_float(const uint32_t* x, float* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::UintToFloat>(out, count, x);
+}
+
+inline void float_to_uint(const float* x, uint32_t* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::FloatToUint>(out, count, x);
+}
+
+inline void fastLog2(const float* x, float* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::FastLog2>(out, count, x);
+}
+
+inline void fastExp2(const float* x, float* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::FastExp2>(out, count, x);
+}
+
+inline void fastRcp(const float* x, float* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::FastRcp>(out, count, x);
+}
+
+inline void fastRsqrt(const float* x, float* out, const size_t count)
+{
+    detail::fmath_simd::transform<detail::fmath_simd::FastRsqrt>(out, count, x);
+}
+
+
+// next2n takes a shared exponent, so doesn't quite fit the above
+inline void next2n(const float* x, const int n, float* out, const size_t count)
+{
+    next2n_variants(x, n, out, count);
+}
+
+
+inline void next2n_u32(const uint32_t* x, const uint32_t n, uint32_t* out, const size_t count)
+{
+    next2n_u32_variants(x, n, out, count);
+}
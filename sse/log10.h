@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 #if defined(_MSC_VER) && defined(_M_X64)
     #include <intrin.h>
 
@@ -10,10 +12,30 @@
     #error "Only really intended for x64 gcc/clang/msc"
 #endif
 
+#include "../generic/runtime_function_loading.h"
+
+
 
+// Number of decimal digits in value minus one (-1 for 0), picked at runtime between the
+// scalar and SSE2 versions, see runtime_function_loading.h, log10_variants can be used to
+// test each of them.
+
+
+namespace detail::log10 {
 
 inline
-int log10(uint32_t value) {
+int scalar(uint32_t value) {
+
+    int ret = -1;
+    for(uint32_t limit : { 0u, 9u, 99u, 999u, 9999u, 99999u, 999999u, 9999999u, 99999999u, 999999999u }) {
+        ret += value > limit;
+    }
+    return ret;
+}
+
+
+MULTIVERSION_TARGET_SSE2 inline
+int sse2(uint32_t value) {
 
     alignas(16) const uint32_t  r0[4]= { 0, 9, 99, 999 };
     alignas(16) const uint32_t  r1[4]= { 9999, 99999, 999999, 9999999 };
@@ -29,24 +51,31 @@ int log10(uint32_t value) {
         _mm_cmpgt_epi32(base, _mm_load_si128((const __m128i*)r2))
     );
 
-    #if 1
-        alignas(16) int buffer[4];
-        _mm_store_si128((__m128i*)buffer, result);
-        int ret = ~(buffer[0] + buffer[1] + buffer[2] + buffer[3]);
-
-    // Both GCC and Clang really struggle to precompute the below
-    #else
-        result = _mm_hadd_epi32(result, result);
-        result = _mm_hadd_epi32(result, result);    
-        int ret = ~_mm_extract_epi32(result, 0);
-    #endif
+    // Both GCC and Clang really struggle to precompute a hadd version of this
+    alignas(16) int buffer[4];
+    _mm_store_si128((__m128i*)buffer, result);
+    int ret = ~(buffer[0] + buffer[1] + buffer[2] + buffer[3]);
 
     // Handle a lack of unsigned compare AFTER computation, to stop
     // the generated opcodes from being crappy due to it favouring an
     // early exit (on clang atleast, gcc still put it at the top :()
     if(value > 0x7fffffff) { ret = 9; }
     return ret;
+}
+
+} // namespace detail::log10
+
+
+inline constinit multiversion<int(uint32_t)> log10_variants {
+    {isa::scalar, detail::log10::scalar},
+    {isa::sse2, detail::log10::sse2},
+};
+
+
+inline
+int log10(uint32_t value) {
 
+    return log10_variants(value);
 }
 
 
@@ -14,12 +14,68 @@
 #include <cstdint>
 
 
-inline
-uint32_t f_parse_32b_hex_string(const char* x)
+#include "../generic/runtime_function_loading.h"
+
+
+namespace detail::parse_32bit_hex_string
+{
+
+// Each byte of the result is the value of one hex character, first character in the top byte
+inline uint64_t unhex_bytes(const char* x)
 {
     uint64_t y = _bswap64(*((const uint64_t*)x)) - 0x3030303030303030ULL;
     uint64_t sh = (y >> 4) & 0x0101010101010101ULL;
     y -= sh * 8;
     y += sh;
+    return y;
+}
+
+inline uint32_t compact_nibbles(uint64_t y)
+{
+    y &= 0x0f0f0f0f0f0f0f0fULL;
+    y = (y | (y >> 4))  & 0x00ff00ff00ff00ffULL;
+    y = (y | (y >> 8))  & 0x0000ffff0000ffffULL;
+    y = (y | (y >> 16)) & 0x00000000ffffffffULL;
+    return (uint32_t)y;
+}
+
+inline void many_scalar(const char* x, uint32_t* out, size_t count)
+{
+    for(size_t i=0; i<count; ++i)
+    {
+        out[i] = compact_nibbles(unhex_bytes(x + i * 8));
+    }
+}
+
+MULTIVERSION_TARGET_AVX2 inline void many_bmi2(const char* x, uint32_t* out, size_t count)
+{
+    for(size_t i=0; i<count; ++i)
+    {
+        out[i] = (uint32_t)_pext_u64(unhex_bytes(x + i * 8), 0x0f0f0f0f0f0f0f0fULL);
+    }
+}
+
+} // namespace detail::parse_32bit_hex_string
+
+
+// Parses exactly 8 hex characters, no validation is done.
+// (See parse_delimited_numbers.h for variable length + validation)
+inline
+uint32_t f_parse_32b_hex_string(const char* x)
+{
+    uint64_t y = detail::parse_32bit_hex_string::unhex_bytes(x);
+#if defined(__BMI2__) || (defined(_MSC_VER) && defined(__AVX2__))
     return (uint32_t)_pext_u64(y, 0x0f0f0f0f0f0f0f0fULL);
+#else
+    // pext is microcoded pre-zen3, so not having BMI2 isn't the end of the world
+    return detail::parse_32bit_hex_string::compact_nibbles(y);
+#endif
 }
+
+
+// Parses count back to back 8 character hex strings (x + 8 * i), using pext when the cpu
+// has BMI2 regardless of what this was compiled for (see runtime_function_loading.h).
+inline constinit multiversion<void(const char*, uint32_t*, size_t)> f_parse_32b_hex_strings {
+    {isa::scalar, detail::parse_32bit_hex_string::many_scalar},
+    {isa::avx2, detail::parse_32bit_hex_string::many_bmi2},
+};
@@ -1,30 +1,16 @@
 
-#if defined(_MSC_VER) && defined(_M_X64)
-    #include <intrin.h>
-
-#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
-    #include <x86intrin.h>
-
-#else
-    #error "Only really intended for x64 gcc/clang/msc"
-#endif
-
-
 #include <algorithm>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 
-
-struct vec2 {
-    float x, y;
-};
+// vec2 and the (runtime picked SSE2 / SSE4.1) floor come from here
+#include "uv_to_udim.h"
 
 
 inline
 uint64_t uv_to_packed_udim(const vec2& uv) {
-    __m128 udim = _mm_floor_ps(_mm_castpd_ps(_mm_load_sd((const double*)&uv)));
-    return (uint64_t)_mm_cvtsi128_si64(_mm_castps_si128(udim));
+    return uv_to_packed_udim(&uv);
 }
 
 inline
@@ -12,6 +12,9 @@
     #error "Only really intended for x64 gcc/clang/msc"
 #endif
 
+#include "../generic/fmath.h"
+#include "../generic/runtime_function_loading.h"
+
 
 struct vec2 {
     float x, y;
@@ -23,19 +26,47 @@ struct vec2i {
 };
 
 
-// Only really clang seems to optimize the naive version in a reasonable way.
+// Every function below is picked at runtime between an SSE2 version (with floor emulated)
+// and an SSE4.1 one (_mm_floor_ps), see runtime_function_loading.h, the *_variants tables
+// can be used to test each of them.
+
+
+namespace detail::uv_to_udim {
+
+// Exact, including -0 and anything too big to have a fraction
 inline
-void uv_to_udim_ids(const vec2* src, vec2i* dst, const uint32_t count) {
+__m128 floor_sse2(const __m128 x) {
+
+    const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    __m128 floored = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+    floored = _mm_or_ps(floored, _mm_and_ps(x, _mm_set1_ps(-0.0f)));
+
+    const __m128 has_fraction = _mm_cmplt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), x), _mm_set1_ps(8388608.0f));
+    return _mm_or_ps(_mm_and_ps(has_fraction, floored), _mm_andnot_ps(has_fraction, x));
+}
+
+
+MULTIVERSION_TARGET_SSE41 inline
+__m128 floor_sse41(const __m128 x) {
+
+    return _mm_floor_ps(x);
+}
+
+
+// Only really clang seems to optimize the naive version in a reasonable way.
+template<__m128 (*floor)(__m128)>
+FORCE_INLINE
+void ids(const vec2* src, vec2i* dst, const uint32_t count) {
 
     uint32_t written = 0;
 
     // Do 8 at a time
     for( ; written < (count & -8) ; written += 8 ) {
 
-        const __m128 R0 = _mm_floor_ps(_mm_loadu_ps( (const float*)&src[written+0] ));
-        const __m128 R1 = _mm_floor_ps(_mm_loadu_ps( (const float*)&src[written+2] ));
-        const __m128 R2 = _mm_floor_ps(_mm_loadu_ps( (const float*)&src[written+4] ));
-        const __m128 R3 = _mm_floor_ps(_mm_loadu_ps( (const float*)&src[written+6] ));
+        const __m128 R0 = floor(_mm_loadu_ps( (const float*)&src[written+0] ));
+        const __m128 R1 = floor(_mm_loadu_ps( (const float*)&src[written+2] ));
+        const __m128 R2 = floor(_mm_loadu_ps( (const float*)&src[written+4] ));
+        const __m128 R3 = floor(_mm_loadu_ps( (const float*)&src[written+6] ));
 
         _mm_storeu_si128((__m128i*)&dst[written+0], _mm_cvtps_epi32( R0 ));
         _mm_storeu_si128((__m128i*)&dst[written+2], _mm_cvtps_epi32( R1 ));
@@ -45,10 +76,10 @@ void uv_to_udim_ids(const vec2* src, vec2i* dst, const uint32_t count) {
     }
 
     // Do the rest 1 at a time
-    for(; written < (count & 8) ; ++written ) {
+    for(; written < count ; ++written ) {
 
         __m128 uv = _mm_castpd_ps(_mm_load_sd((const double*)&src[written]));
-        const __m128 udim = _mm_floor_ps(uv);
+        const __m128 udim = floor(uv);
         _mm_storel_epi64((__m128i*)&dst[written], _mm_cvtps_epi32( udim ));
 
     }
@@ -56,8 +87,9 @@ void uv_to_udim_ids(const vec2* src, vec2i* dst, const uint32_t count) {
 }
 
 
-inline
-bool uvs_to_udim_ids_and_test_for_same_udim(const vec2* src, vec2i* dst, const uint32_t count) {
+template<__m128 (*floor)(__m128)>
+FORCE_INLINE
+bool ids_and_test_for_same_udim(const vec2* src, vec2i* dst, const uint32_t count) {
 
     // If there is nothing to stream, really there is a case for both the udims all being
     // the same, and them not being the same.
@@ -67,15 +99,15 @@ bool uvs_to_udim_ids_and_test_for_same_udim(const vec2* src, vec2i* dst, const u
 
     // Start off with a flag = true, and do an initial calculation of the first udim
     __m128 same_flag = _mm_castsi128_ps(_mm_set1_epi32(0xffffffff));
-    __m128 first_udim = _mm_floor_ps(_mm_castpd_ps(_mm_load1_pd((const double*)&src[0])));
+    __m128 first_udim = floor(_mm_castpd_ps(_mm_load1_pd((const double*)&src[0])));
 
     // Do 8 at a time
     for( ; written < (count & -8) ; written += 8 ) {
 
-        const __m128 R0 = _mm_floor_ps(_mm_loadu_ps( (const float*)&src[written+0] ));
-        const __m128 R1 = _mm_floor_ps(_mm_loadu_ps( (const float*)&src[written+2] ));
-        const __m128 R2 = _mm_floor_ps(_mm_loadu_ps( (const float*)&src[written+4] ));
-        const __m128 R3 = _mm_floor_ps(_mm_loadu_ps( (const float*)&src[written+6] ));
+        const __m128 R0 = floor(_mm_loadu_ps( (const float*)&src[written+0] ));
+        const __m128 R1 = floor(_mm_loadu_ps( (const float*)&src[written+2] ));
+        const __m128 R2 = floor(_mm_loadu_ps( (const float*)&src[written+4] ));
+        const __m128 R3 = floor(_mm_loadu_ps( (const float*)&src[written+6] ));
 
         _mm_storeu_si128((__m128i*)&dst[written+0], _mm_cvtps_epi32( R0 ));
         _mm_storeu_si128((__m128i*)&dst[written+2], _mm_cvtps_epi32( R1 ));
@@ -89,11 +121,11 @@ bool uvs_to_udim_ids_and_test_for_same_udim(const vec2* src, vec2i* dst, const u
 
     }
 
-    // Do the rest 1 at a time
-    for(; written < (count & 8) ; ++written ) {
+    // Do the rest 1 at a time, loaded into both halves like first_udim was
+    for(; written < count ; ++written ) {
 
-        __m128 uv = _mm_castpd_ps(_mm_load_sd((const double*)&src[written]));
-        const __m128 udim = _mm_floor_ps(uv);
+        __m128 uv = _mm_castpd_ps(_mm_load1_pd((const double*)&src[written]));
+        const __m128 udim = floor(uv);
         _mm_storel_epi64((__m128i*)&dst[written], _mm_cvtps_epi32( udim ));
 
         same_flag = _mm_and_ps( same_flag, _mm_cmpeq_ps( first_udim, udim ) );
@@ -105,9 +137,59 @@ bool uvs_to_udim_ids_and_test_for_same_udim(const vec2* src, vec2i* dst, const u
 }
 
 
+template<__m128 (*floor)(__m128)>
+FORCE_INLINE
+uint64_t packed_udim(const vec2* uv) {
+    __m128 udim = floor(_mm_castpd_ps(_mm_load_sd((const double*)uv)));
+    return (uint64_t)_mm_cvtsi128_si64(_mm_castps_si128(udim));
+}
+
+
+inline void ids_sse2(const vec2* src, vec2i* dst, const uint32_t count) { ids<floor_sse2>(src, dst, count); }
+MULTIVERSION_TARGET_SSE41 inline void ids_sse41(const vec2* src, vec2i* dst, const uint32_t count) { ids<floor_sse41>(src, dst, count); }
+
+inline bool ids_and_test_for_same_udim_sse2(const vec2* src, vec2i* dst, const uint32_t count) { return ids_and_test_for_same_udim<floor_sse2>(src, dst, count); }
+MULTIVERSION_TARGET_SSE41 inline bool ids_and_test_for_same_udim_sse41(const vec2* src, vec2i* dst, const uint32_t count) { return ids_and_test_for_same_udim<floor_sse41>(src, dst, count); }
+
+inline uint64_t packed_udim_sse2(const vec2* uv) { return packed_udim<floor_sse2>(uv); }
+MULTIVERSION_TARGET_SSE41 inline uint64_t packed_udim_sse41(const vec2* uv) { return packed_udim<floor_sse41>(uv); }
+
+} // namespace detail::uv_to_udim
+
+
+inline constinit multiversion<void(const vec2*, vec2i*, uint32_t)> uv_to_udim_ids_variants {
+    {isa::sse2, detail::uv_to_udim::ids_sse2},
+    {isa::sse41, detail::uv_to_udim::ids_sse41},
+};
+
+inline constinit multiversion<bool(const vec2*, vec2i*, uint32_t)> uvs_to_udim_ids_and_test_for_same_udim_variants {
+    {isa::sse2, detail::uv_to_udim::ids_and_test_for_same_udim_sse2},
+    {isa::sse41, detail::uv_to_udim::ids_and_test_for_same_udim_sse41},
+};
+
+inline constinit multiversion<uint64_t(const vec2*)> uv_to_packed_udim_variants {
+    {isa::sse2, detail::uv_to_udim::packed_udim_sse2},
+    {isa::sse41, detail::uv_to_udim::packed_udim_sse41},
+};
+
+
+inline
+void uv_to_udim_ids(const vec2* src, vec2i* dst, const uint32_t count) {
+
+    uv_to_udim_ids_variants(src, dst, count);
+}
+
+
+inline
+bool uvs_to_udim_ids_and_test_for_same_udim(const vec2* src, vec2i* dst, const uint32_t count) {
+
+    return uvs_to_udim_ids_and_test_for_same_udim_variants(src, dst, count);
+}
+
+
 // returns [uf32, vf32] packed (for use in a set etc)
 inline
 uint64_t uv_to_packed_udim(const vec2* uv) {
-    __m128 udim = _mm_floor_ps(_mm_castpd_ps(_mm_load_sd((const double*)uv)));
-    return (uint64_t)_mm_cvtsi128_si64(_mm_castps_si128(udim));
+
+    return uv_to_packed_udim_variants(uv);
 }